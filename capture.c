@@ -0,0 +1,602 @@
+/*
+
+  ----------------------------------------------------
+  vsm - vector space model data similarity
+  ----------------------------------------------------
+
+  Copyright (c) 2008 Jason Bittel <jason.bittel@gmail.com>
+
+*/
+
+/*
+  Scoring of HTTP traffic read directly from pcap capture files. TCP
+  segments to or from port 80 are reassembled into the byte stream of each
+  connection, following it from the handshake through to a reset or the
+  exchange of FINs, and the payload of both directions is tokenized into an
+  index belonging to that connection. When a connection ends its index is
+  scored against the query and a similarity tagged with the connection is
+  printed. Only connections whose SYN was captured are followed, and IP
+  fragments are not reassembled. Connections still open at the end of the
+  capture, or idle for CONN_TIMEOUT seconds of capture time, are scored
+  with whatever data they carried.
+
+  The payload is scored as it appears on the wire: the request and
+  response headers are indexed along with the bodies, and a body sent with
+  a Content-Encoding such as gzip, or in chunked transfer encoding, is
+  indexed without being decoded. The index memory limit is split evenly
+  between the connections open at any time.
+*/
+
+#define PCAP_HEADER_LEN 24
+#define PCAP_RECORD_LEN 16
+#define MAX_SNAPLEN 262144
+#define CONN_TABLE_SIZE 4093
+#define MAX_PENDING_SIZE (1024 * 1024)
+#define CONN_TIMEOUT 300
+#define SWEEP_INTERVAL 60
+
+#define LINKTYPE_NULL 0
+#define LINKTYPE_ETHERNET 1
+#define LINKTYPE_RAW 101
+#define LINKTYPE_LINUX_SLL 113
+#define ETHERTYPE_IP 0x0800
+#define ETHERTYPE_VLAN 0x8100
+#define PROTOCOL_TCP 6
+
+#define TH_FIN 0x01
+#define TH_SYN 0x02
+#define TH_RST 0x04
+#define TH_ACK 0x10
+
+/* Sequence number arithmetic, modulo 2^32 */
+#define SEQ_ADD(a, n) (((a) + (n)) & 0xffffffffUL)
+#define SEQ_SUB(a, b) (((a) - (b)) & 0xffffffffUL)
+#define SEQ_LT(a, b) (SEQ_SUB(a, b) > 0x7fffffffUL)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "capture.h"
+#include "error.h"
+#include "html.h"
+#include "index.h"
+#include "score.h"
+#include "tokenize.h"
+
+/* Connection states, following the names tcpick reports */
+#define STATE_SYN_SENT 0
+#define STATE_SYN_RECEIVED 1
+#define STATE_ESTABLISHED 2
+#define STATE_FIN_WAIT 3
+#define STATE_CLOSED 4
+#define STATE_RESET 5
+#define STATE_TIMED_OUT 6
+
+static char *state_names[] = {
+        "SYN-SENT", "SYN-RECEIVED", "ESTABLISHED", "FIN-WAIT",
+        "CLOSED", "RESET", "TIMED-OUT"
+};
+
+/* Segment that arrived ahead of a gap in the stream */
+typedef struct segment SEGMENT;
+struct segment {
+        unsigned long seq;
+        size_t len;
+        unsigned char *data;
+        SEGMENT *next;
+};
+
+/* One direction of a connection */
+typedef struct flow FLOW;
+struct flow {
+        unsigned long addr;
+        unsigned int port;
+        unsigned long next_seq;           /* Next byte expected in order */
+        int have_seq;
+        int fin;
+        SEGMENT *pending;                 /* Out of order segments, by seq */
+        size_t pending_len;
+        char line[MAX_LINE_LEN];          /* Partial line awaiting more data */
+        int line_len;
+        HTML_STATE html;
+};
+
+typedef struct connection CONNECTION;
+struct connection {
+        int num;
+        int state;
+        long last_seen;
+        FLOW client;
+        FLOW server;
+        INDEX *idx;
+        CONNECTION *hash_next;
+        CONNECTION *prev, *next;          /* Open connections, oldest first */
+};
+
+static CONNECTION *conn_table[CONN_TABLE_SIZE];
+static CONNECTION *oldest = NULL;
+static CONNECTION *newest = NULL;
+static int num_conns = 0;
+static int num_open = 0;
+static int *query = NULL;
+static size_t mem_limit = 0;
+
+void process_packet(unsigned char *p, size_t len, int link_type, long ts);
+void process_segment(unsigned long src, unsigned int sport, unsigned long dst, unsigned int dport,
+                     unsigned long seq, int flags, unsigned char *data, size_t len, long ts);
+CONNECTION *find_connection(unsigned long src, unsigned int sport, unsigned long dst, unsigned int dport);
+CONNECTION *new_connection(unsigned long src, unsigned int sport, unsigned long dst, unsigned int dport,
+                           unsigned long seq);
+void finish_connection(CONNECTION *conn, int state);
+void expire_connections(long now);
+void share_memory();
+void reassemble(CONNECTION *conn, FLOW *flow, unsigned long seq, unsigned char *data, size_t len);
+void queue_segment(FLOW *flow, unsigned long seq, unsigned char *data, size_t len);
+void drain_segments(CONNECTION *conn, FLOW *flow, int skip_gaps);
+void append_payload(CONNECTION *conn, FLOW *flow, unsigned char *data, size_t len);
+void flush_line(CONNECTION *conn, FLOW *flow);
+unsigned int conn_hash(unsigned long src, unsigned int sport, unsigned long dst, unsigned int dport);
+unsigned long get_u32(unsigned char *p, int big_endian);
+void format_addr(char *buf, unsigned long addr);
+
+#define get16(p) ((unsigned int) (p)[0] << 8 | (p)[1])
+#define get32(p) get_u32(p, 1)
+
+/* Read a pcap capture, from STDIN if filename is NULL, and print the
+   similarity of each HTTP connection in it */
+void score_capture(char *filename, int *terms, size_t limit) {
+        FILE *fp;
+        unsigned char hdr[PCAP_HEADER_LEN];
+        unsigned char *pkt = NULL, *tmp;
+        size_t pkt_size = 0;
+        unsigned long caplen;
+        int big_endian = 0, link_type;
+        long ts, last_sweep = 0;
+        char *name = (filename) ? filename : "STDIN";
+
+        query = terms;
+        mem_limit = limit;
+        num_conns = 0;
+        num_open = 0;
+
+        if (filename) {
+                if ((fp = fopen(filename, "rb")) == NULL) {
+                        DIE("\nCannot open file '%s'", filename);
+                }
+                PRINT("\nReading capture file '%s'", filename);
+        } else {
+                fp = stdin;
+                PRINT("\nReading capture from STDIN");
+        }
+
+        if (fread(hdr, 1, PCAP_HEADER_LEN, fp) != PCAP_HEADER_LEN) {
+                DIE("Cannot read capture header from '%s'", name);
+        }
+
+        /* The magic number gives the byte order of the file */
+        if (!memcmp(hdr, "\xa1\xb2\xc3\xd4", 4) || !memcmp(hdr, "\xa1\xb2\x3c\x4d", 4)) {
+                big_endian = 1;
+        } else if (!memcmp(hdr, "\xd4\xc3\xb2\xa1", 4) || !memcmp(hdr, "\x4d\x3c\xb2\xa1", 4)) {
+                big_endian = 0;
+        } else {
+                DIE("'%s' is not a pcap capture file", name);
+        }
+
+        link_type = (int) (get_u32(hdr + 20, big_endian) & 0xffff);
+        if (link_type != LINKTYPE_NULL && link_type != LINKTYPE_ETHERNET &&
+            link_type != LINKTYPE_RAW && link_type != LINKTYPE_LINUX_SLL) {
+                DIE("Unsupported link type %d in '%s'", link_type, name);
+        }
+
+        while (fread(hdr, 1, PCAP_RECORD_LEN, fp) == PCAP_RECORD_LEN) {
+                ts = (long) get_u32(hdr, big_endian);
+                caplen = get_u32(hdr + 8, big_endian);
+
+                if (caplen > MAX_SNAPLEN) DIE("Corrupt packet record in '%s'", name);
+                if (caplen > pkt_size) {
+                        if ((tmp = realloc(pkt, caplen)) == NULL) {
+                                DIE("Cannot realloc memory for packet buffer");
+                        }
+                        pkt = tmp;
+                        pkt_size = caplen;
+                }
+
+                if (fread(pkt, 1, caplen, fp) != caplen) {
+                        WARN("Capture file '%s' ends in a truncated packet", name);
+                        break;
+                }
+
+                process_packet(pkt, caplen, link_type, ts);
+
+                if (ts - last_sweep >= SWEEP_INTERVAL) {
+                        expire_connections(ts);
+                        last_sweep = ts;
+                }
+        }
+
+        /* Score whatever is still open at the end of the capture */
+        while (oldest) finish_connection(oldest, oldest->state);
+
+        PRINT("Capture contained %d HTTP connections", num_conns);
+
+        free(pkt);
+        if (filename) fclose(fp);
+
+        return;
+}
+
+/* Strip the link and IP headers from a captured frame and hand any TCP
+   segment on */
+void process_packet(unsigned char *p, size_t len, int link_type, long ts) {
+        unsigned int ether_type, ip_hl, ip_len, tcp_hl;
+
+        switch (link_type) {
+                case LINKTYPE_NULL:
+                        /* Address family, in the capturing host's byte order */
+                        if (len < 4 || (p[0] != 2 && p[3] != 2)) return;
+                        p += 4;
+                        len -= 4;
+                        break;
+                case LINKTYPE_ETHERNET:
+                        if (len < 14) return;
+                        ether_type = get16(p + 12);
+                        p += 14;
+                        len -= 14;
+                        while (ether_type == ETHERTYPE_VLAN && len >= 4) {
+                                ether_type = get16(p + 2);
+                                p += 4;
+                                len -= 4;
+                        }
+                        if (ether_type != ETHERTYPE_IP) return;
+                        break;
+                case LINKTYPE_LINUX_SLL:
+                        if (len < 16 || get16(p + 14) != ETHERTYPE_IP) return;
+                        p += 16;
+                        len -= 16;
+                        break;
+        }
+
+        /* IPv4 header; fragments are ignored */
+        if (len < 20 || (p[0] >> 4) != 4 || p[9] != PROTOCOL_TCP) return;
+        if (get16(p + 6) & 0x3fff) return;
+
+        ip_hl = (p[0] & 0x0f) * 4;
+        ip_len = get16(p + 2);
+        if (ip_hl < 20 || ip_len < ip_hl) return;
+        if (ip_len < len) len = ip_len; /* Drop link layer padding */
+        if (len < ip_hl + 20) return;
+
+        /* TCP header */
+        tcp_hl = (p[ip_hl + 12] >> 4) * 4;
+        if (tcp_hl < 20 || ip_hl + tcp_hl > len) return;
+
+        process_segment(get32(p + 12), get16(p + ip_hl), get32(p + 16), get16(p + ip_hl + 2),
+                        get32(p + ip_hl + 4), p[ip_hl + 13], p + ip_hl + tcp_hl,
+                        len - ip_hl - tcp_hl, ts);
+
+        return;
+}
+
+/* Advance the state of the connection a segment belongs to and feed its
+   payload into the stream */
+void process_segment(unsigned long src, unsigned int sport, unsigned long dst, unsigned int dport,
+                     unsigned long seq, int flags, unsigned char *data, size_t len, long ts) {
+        CONNECTION *conn;
+        FLOW *flow;
+
+        if (sport != HTTP_PORT && dport != HTTP_PORT) return;
+
+        conn = find_connection(src, sport, dst, dport);
+
+        /* A fresh SYN on a port pair still in use starts a new connection */
+        if (conn && (flags & (TH_SYN | TH_ACK)) == TH_SYN && conn->state >= STATE_ESTABLISHED) {
+                finish_connection(conn, STATE_CLOSED);
+                conn = NULL;
+        }
+
+        if (!conn) {
+                if ((flags & (TH_SYN | TH_ACK | TH_RST)) == TH_SYN) {
+                        conn = new_connection(src, sport, dst, dport, seq);
+                        conn->last_seen = ts;
+                }
+
+                return;
+        }
+
+        conn->last_seen = ts;
+        flow = (src == conn->client.addr && sport == conn->client.port) ? &conn->client : &conn->server;
+
+        if (flags & TH_RST) {
+                finish_connection(conn, STATE_RESET);
+                return;
+        }
+
+        if (flags & TH_SYN) {
+                if (flow == &conn->server && !flow->have_seq) {
+                        flow->next_seq = SEQ_ADD(seq, 1);
+                        flow->have_seq = 1;
+                        conn->state = STATE_SYN_RECEIVED;
+                }
+
+                return;
+        }
+
+        if (conn->state < STATE_ESTABLISHED && flow == &conn->client) {
+                conn->state = STATE_ESTABLISHED;
+                PRINT("Established connection %d", conn->num);
+        }
+
+        /* The SYN/ACK may have been missed; start from what we have */
+        if (!flow->have_seq) {
+                flow->next_seq = seq;
+                flow->have_seq = 1;
+        }
+
+        if (len > 0) reassemble(conn, flow, seq, data, len);
+
+        if (flags & TH_FIN) {
+                flow->fin = 1;
+                if (conn->client.fin && conn->server.fin) {
+                        finish_connection(conn, STATE_CLOSED);
+                } else {
+                        conn->state = STATE_FIN_WAIT;
+                }
+        }
+
+        return;
+}
+
+/* Look up the open connection between two endpoints, in either direction */
+CONNECTION *find_connection(unsigned long src, unsigned int sport, unsigned long dst, unsigned int dport) {
+        CONNECTION *conn;
+
+        for (conn = conn_table[conn_hash(src, sport, dst, dport)]; conn; conn = conn->hash_next) {
+                if (conn->client.addr == src && conn->client.port == sport &&
+                    conn->server.addr == dst && conn->server.port == dport) return conn;
+                if (conn->client.addr == dst && conn->client.port == dport &&
+                    conn->server.addr == src && conn->server.port == sport) return conn;
+        }
+
+        return NULL;
+}
+
+/* Begin tracking a connection from the client's SYN */
+CONNECTION *new_connection(unsigned long src, unsigned int sport, unsigned long dst, unsigned int dport,
+                           unsigned long seq) {
+        CONNECTION *conn;
+        unsigned int h;
+
+        if ((conn = (CONNECTION *) calloc(1, sizeof(CONNECTION))) == NULL) {
+                DIE("Cannot calloc memory for connection");
+        }
+
+        conn->num = ++num_conns;
+        conn->state = STATE_SYN_SENT;
+        conn->client.addr = src;
+        conn->client.port = sport;
+        conn->client.next_seq = SEQ_ADD(seq, 1);
+        conn->client.have_seq = 1;
+        conn->server.addr = dst;
+        conn->server.port = dport;
+        init_html(&conn->client.html);
+        init_html(&conn->server.html);
+
+        /* Many connections are built at once; keep their words out of the
+           shared dictionary so they are freed when the connection ends */
+        conn->idx = create_index();
+        isolate_index(conn->idx);
+
+        h = conn_hash(src, sport, dst, dport);
+        conn->hash_next = conn_table[h];
+        conn_table[h] = conn;
+
+        conn->prev = newest;
+        if (newest) newest->next = conn;
+        else oldest = conn;
+        newest = conn;
+        num_open++;
+        share_memory();
+
+        PRINT("Created connection %d", conn->num);
+
+        return conn;
+}
+
+/* Score a connection that has ended and stop tracking it */
+void finish_connection(CONNECTION *conn, int state) {
+        CONNECTION **i;
+        char client[16], server[16];
+        float scores[MAX_MODELS];
+
+        conn->state = state;
+        PRINT("Terminated connection %d (%s)", conn->num, state_names[state]);
+
+        drain_segments(conn, &conn->client, 1);
+        drain_segments(conn, &conn->server, 1);
+        flush_line(conn, &conn->client);
+        flush_line(conn, &conn->server);
+
+        PRINT("Connection contained %d valid terms", index_stats(conn->idx)->num_insertions);
+        score_index(conn->idx, query, scores);
+
+        format_addr(client, conn->client.addr);
+        format_addr(server, conn->server.addr);
+        print_similarity(scores, "connection %d %s:%u > %s:%u %s", conn->num,
+                         client, conn->client.port, server, conn->server.port, state_names[state]);
+
+        /* Unlink from the hash chain and the list of open connections */
+        for (i = &conn_table[conn_hash(conn->client.addr, conn->client.port,
+                                       conn->server.addr, conn->server.port)]; *i; i = &(*i)->hash_next) {
+                if (*i == conn) {
+                        *i = conn->hash_next;
+                        break;
+                }
+        }
+
+        if (conn->prev) conn->prev->next = conn->next;
+        else oldest = conn->next;
+        if (conn->next) conn->next->prev = conn->prev;
+        else newest = conn->prev;
+        num_open--;
+        share_memory();
+
+        destroy_index(conn->idx);
+        free(conn);
+
+        return;
+}
+
+/* Score connections that have seen no traffic for CONN_TIMEOUT seconds */
+void expire_connections(long now) {
+        CONNECTION *conn, *next;
+
+        for (conn = oldest; conn; conn = next) {
+                next = conn->next;
+                if (now - conn->last_seen > CONN_TIMEOUT) finish_connection(conn, STATE_TIMED_OUT);
+        }
+
+        return;
+}
+
+/* Split the index memory limit evenly between the open connections; an
+   index over its new share spills on its next term */
+void share_memory() {
+        CONNECTION *conn;
+
+        if (!mem_limit || num_open == 0) return;
+
+        for (conn = oldest; conn; conn = conn->next) {
+                set_memory_limit(conn->idx, mem_limit / num_open);
+        }
+
+        return;
+}
+
+/* Deliver a segment's payload in stream order, holding it back if it
+   arrived ahead of a gap */
+void reassemble(CONNECTION *conn, FLOW *flow, unsigned long seq, unsigned char *data, size_t len) {
+        unsigned long skip;
+
+        /* Trim anything already delivered */
+        if (SEQ_LT(seq, flow->next_seq)) {
+                skip = SEQ_SUB(flow->next_seq, seq);
+                if (skip >= len) return;
+                data += skip;
+                len -= skip;
+                seq = flow->next_seq;
+        }
+
+        if (seq != flow->next_seq) {
+                if (flow->pending_len + len <= MAX_PENDING_SIZE) {
+                        queue_segment(flow, seq, data, len);
+                        return;
+                }
+
+                /* Too much is waiting on the gap; assume it was lost */
+                drain_segments(conn, flow, 1);
+                reassemble(conn, flow, seq, data, len);
+
+                return;
+        }
+
+        append_payload(conn, flow, data, len);
+        flow->next_seq = SEQ_ADD(seq, len);
+        drain_segments(conn, flow, 0);
+
+        return;
+}
+
+/* Keep a copy of an out of order segment, ordered by sequence number */
+void queue_segment(FLOW *flow, unsigned long seq, unsigned char *data, size_t len) {
+        SEGMENT *s, **i;
+
+        if ((s = (SEGMENT *) malloc(sizeof(SEGMENT) + len)) == NULL) {
+                DIE("Cannot malloc memory for segment");
+        }
+        s->seq = seq;
+        s->len = len;
+        s->data = (unsigned char *) (s + 1);
+        memcpy(s->data, data, len);
+
+        for (i = &flow->pending; *i && SEQ_LT((*i)->seq, seq); i = &(*i)->next);
+        s->next = *i;
+        *i = s;
+        flow->pending_len += len;
+
+        return;
+}
+
+/* Deliver queued segments that now follow on in the stream; with
+   skip_gaps, deliver all of them, jumping over any missing data */
+void drain_segments(CONNECTION *conn, FLOW *flow, int skip_gaps) {
+        SEGMENT *s;
+        unsigned long skip;
+
+        while ((s = flow->pending)) {
+                if (SEQ_LT(flow->next_seq, s->seq)) {
+                        if (!skip_gaps) break;
+                        flow->next_seq = s->seq;
+                }
+
+                flow->pending = s->next;
+                flow->pending_len -= s->len;
+
+                skip = SEQ_SUB(flow->next_seq, s->seq);
+                if (skip < s->len) {
+                        append_payload(conn, flow, s->data + skip, s->len - skip);
+                        flow->next_seq = SEQ_ADD(s->seq, s->len);
+                }
+
+                free(s);
+        }
+
+        return;
+}
+
+/* Split stream data into lines for the tokenizer, wrapping overlong lines
+   at the same length fgets() would */
+void append_payload(CONNECTION *conn, FLOW *flow, unsigned char *data, size_t len) {
+        size_t i;
+
+        for (i = 0; i < len; i++) {
+                flow->line[flow->line_len++] = (data[i] == '\0') ? ' ' : (char) data[i];
+
+                if (data[i] == '\n' || flow->line_len == MAX_LINE_LEN - 2) flush_line(conn, flow);
+        }
+
+        return;
+}
+
+/* Tokenize the buffered partial line of a flow */
+void flush_line(CONNECTION *conn, FLOW *flow) {
+        if (flow->line_len == 0) return;
+
+        flow->line[flow->line_len] = '\0';
+        flow->line_len = 0;
+
+        if (do_html) strip_html(&flow->html, flow->line);
+        tokenize_line(conn->idx, flow->line);
+
+        return;
+}
+
+/* Bucket for a connection, the same for either direction */
+unsigned int conn_hash(unsigned long src, unsigned int sport, unsigned long dst, unsigned int dport) {
+        return (unsigned int) ((src ^ dst ^ (sport ^ dport) * 2654435761UL) % CONN_TABLE_SIZE);
+}
+
+/* Read a 32 bit value stored in the given byte order */
+unsigned long get_u32(unsigned char *p, int big_endian) {
+        if (big_endian) {
+                return (unsigned long) p[0] << 24 | (unsigned long) p[1] << 16 | (unsigned long) p[2] << 8 | p[3];
+        }
+
+        return (unsigned long) p[3] << 24 | (unsigned long) p[2] << 16 | (unsigned long) p[1] << 8 | p[0];
+}
+
+/* Write an IPv4 address in dotted quad notation */
+void format_addr(char *buf, unsigned long addr) {
+        sprintf(buf, "%lu.%lu.%lu.%lu", addr >> 24 & 0xff, addr >> 16 & 0xff, addr >> 8 & 0xff, addr & 0xff);
+
+        return;
+}
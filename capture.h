@@ -0,0 +1,20 @@
+/*
+
+  ----------------------------------------------------
+  vsm - vector space model data similarity
+  ----------------------------------------------------
+
+  Copyright (c) 2008 Jason Bittel <jason.bittel@gmail.com>
+
+*/
+
+#ifndef _HAVE_CAPTURE_H
+#define _HAVE_CAPTURE_H
+
+#include <stddef.h>
+
+#define HTTP_PORT 80
+
+void score_capture(char *filename, int *query, size_t mem_limit);
+
+#endif /* ! _HAVE_CAPTURE_H */
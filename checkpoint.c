@@ -0,0 +1,268 @@
+/*
+
+  ----------------------------------------------------
+  vsm - vector space model data similarity
+  ----------------------------------------------------
+
+  Copyright (c) 2008 Jason Bittel <jason.bittel@gmail.com>
+
+*/
+
+/*
+  Incremental indexing of append-only data files. After a file is read, its
+  term counts are saved in a checkpoint along with the byte offset reached
+  and a fingerprint of the file (device, inode and a hash of its leading
+  bytes). The next run restores the counts and only reads the bytes that
+  were appended since. A file that was truncated, rotated or replaced no
+  longer matches its fingerprint and is indexed from the beginning.
+
+  A trailing line without a newline may still be in the middle of being
+  written, so it is scored but left out of the checkpoint; the next run
+  reads it again in full. When near-duplicates are being detected, the
+  signature of the text read so far is saved too; a checkpoint written
+  without one can't be resumed by such a run.
+
+  Each checkpoint holds the whole vocabulary of the file, so saving one
+  costs time proportional to the number of distinct terms rather than to
+  the data appended.
+*/
+
+#define _XOPEN_SOURCE 600
+#define _FILE_OFFSET_BITS 64
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include "checkpoint.h"
+#include "dedup.h"
+#include "error.h"
+#include "html.h"
+#include "index.h"
+#include "spill.h"
+#include "tokenize.h"
+
+#define CHECKPOINT_MAGIC "VSMCKPT2"
+
+typedef struct checkpoint_header CHECKPOINT_HEADER;
+struct checkpoint_header {
+        char magic[8];
+        unsigned long long options;       /* Term options the counts were built with */
+        unsigned long long dev, ino;
+        unsigned long long offset;        /* Bytes of the data file consumed */
+        unsigned long long head_hash;     /* Hash of the leading bytes */
+        HTML_STATE html;                  /* Markup state at offset, with -x */
+        SIG_STATE sig;                    /* Signature of the text before offset */
+        int have_sig;                     /* Set if sig was being gathered */
+        int name_len;                     /* Length of the data file name that follows */
+};
+
+char *checkpoint_path(char *dir, char *filename);
+unsigned long long term_options();
+unsigned long long hash_head(FILE *fp, off_t offset);
+off_t restore_checkpoint(INDEX *idx, HTML_STATE *html, char *dir, char *filename, FILE *fp);
+int load_checkpoint(INDEX *idx, FILE *ckpt, CHECKPOINT_HEADER *hdr, char *filename, FILE *fp);
+void save_checkpoint(INDEX *idx, HTML_STATE *html, char *dir, char *filename, FILE *fp, off_t offset);
+void save_term(char *w, unsigned int freq, void *arg);
+
+/* Build the index for filename, resuming from its checkpoint in dir when
+   one matches and saving a new checkpoint afterwards */
+void build_index_incremental(INDEX *idx, char *dir, char *filename) {
+        FILE *fp;
+        HTML_STATE html;
+        char buf[MAX_LINE_LEN];
+        char *line;
+        off_t pos;
+        size_t len;
+        int saved = 0;
+
+        if ((fp = fopen(filename, "r")) == NULL) {
+                DIE("\nCannot open file '%s'", filename);
+        }
+
+        init_html(&html);
+        pos = restore_checkpoint(idx, &html, dir, filename, fp);
+        if (fseeko(fp, pos, SEEK_SET) != 0) {
+                DIE("Cannot seek in file '%s'", filename);
+        }
+
+        while ((line = fgets(buf, sizeof(buf) - 1, fp))) {
+                len = strlen(line);
+
+                /* A short line without a newline can only be the last one;
+                   checkpoint before it in case it is still being written */
+                if (len > 0 && len < sizeof(buf) - 2 && line[len - 1] != '\n') {
+                        save_checkpoint(idx, &html, dir, filename, fp, pos);
+                        saved = 1;
+                }
+
+                pos += len;
+                if (do_html) strip_html(&html, line);
+                tokenize_line(idx, line);
+        }
+
+        if (!saved) save_checkpoint(idx, &html, dir, filename, fp, pos);
+
+        fclose(fp);
+
+        return;
+}
+
+/* Return the checkpoint file name for filename; the caller must free it */
+char *checkpoint_path(char *dir, char *filename) {
+        char *path;
+
+        if ((path = (char *) malloc(strlen(dir) + 24)) == NULL) {
+                DIE("Cannot malloc memory for checkpoint path");
+        }
+        sprintf(path, "%s/%016llx.ckpt", dir, hash_word(filename, strlen(filename)));
+
+        return path;
+}
+
+/* Encode the term options, since counts built with different options
+   can't be combined */
+unsigned long long term_options() {
+        return (unsigned long long) min_len << 3 | do_html << 2 | do_stop_words << 1 | do_stemming;
+}
+
+/* Hash up to CHECKPOINT_HEAD_LEN leading bytes of the data file, but never
+   more than the offset reached, so the value is stable as the file grows */
+unsigned long long hash_head(FILE *fp, off_t offset) {
+        char buf[CHECKPOINT_HEAD_LEN];
+        ssize_t n;
+
+        if (offset > CHECKPOINT_HEAD_LEN) offset = CHECKPOINT_HEAD_LEN;
+        if ((n = pread(fileno(fp), buf, offset, 0)) < 0) n = 0;
+
+        return hash_word(buf, n);
+}
+
+/* Load the checkpoint for filename into idx if it still describes the
+   file; returns the offset to resume reading from, or 0 */
+off_t restore_checkpoint(INDEX *idx, HTML_STATE *html, char *dir, char *filename, FILE *fp) {
+        CHECKPOINT_HEADER hdr;
+        char *path;
+        FILE *ckpt;
+        off_t offset = 0;
+
+        path = checkpoint_path(dir, filename);
+        if ((ckpt = fopen(path, "rb")) == NULL) {
+                PRINT("No checkpoint found for '%s'", filename);
+                free(path);
+                return 0;
+        }
+
+        if (load_checkpoint(idx, ckpt, &hdr, filename, fp)) {
+                offset = hdr.offset;
+                *html = hdr.html;
+                if (index_signature(idx)) *index_signature(idx) = hdr.sig;
+                PRINT("Resuming from checkpoint at byte %llu", hdr.offset);
+        } else {
+                PRINT("Checkpoint for '%s' is stale, reading from the beginning", filename);
+                initialize_index(idx);
+        }
+
+        fclose(ckpt);
+        free(path);
+
+        return offset;
+}
+
+/* Validate a checkpoint against the data file and insert its terms;
+   returns 0 if it does not match */
+int load_checkpoint(INDEX *idx, FILE *ckpt, CHECKPOINT_HEADER *hdr, char *filename, FILE *fp) {
+        char word[MAX_LINE_LEN];
+        struct stat st;
+        unsigned int freq;
+        int len;
+
+        if (fread(hdr, sizeof(*hdr), 1, ckpt) != 1) return 0;
+        if (memcmp(hdr->magic, CHECKPOINT_MAGIC, sizeof(hdr->magic)) != 0) return 0;
+        if (hdr->options != term_options()) return 0;
+        if (index_signature(idx) && !hdr->have_sig) return 0;
+
+        /* Guard against two names hashing to the same checkpoint */
+        if (hdr->name_len != (int) strlen(filename) || hdr->name_len >= MAX_LINE_LEN) return 0;
+        if (fread(word, 1, hdr->name_len, ckpt) != (size_t) hdr->name_len) return 0;
+        if (memcmp(word, filename, hdr->name_len) != 0) return 0;
+
+        /* Rotated, replaced or truncated files are rebuilt */
+        if (fstat(fileno(fp), &st) != 0) return 0;
+        if (hdr->dev != (unsigned long long) st.st_dev ||
+            hdr->ino != (unsigned long long) st.st_ino) return 0;
+        if (hdr->offset > (unsigned long long) st.st_size) return 0;
+        if (hdr->head_hash != hash_head(fp, hdr->offset)) return 0;
+
+        while ((len = read_run_term(ckpt, word, &freq)) > 0) {
+                insert_term(idx, word, len, freq);
+        }
+
+        return len == 0;
+}
+
+/* Write the index and current position of filename to its checkpoint;
+   the file is written under a temporary name and renamed into place */
+void save_checkpoint(INDEX *idx, HTML_STATE *html, char *dir, char *filename, FILE *fp, off_t offset) {
+        CHECKPOINT_HEADER hdr;
+        struct stat st;
+        char *path, *tmp_path;
+        FILE *ckpt;
+
+        if (index_stats(idx)->num_runs > 0) {
+                WARN("Index for '%s' spilled to disk; no checkpoint saved", filename);
+                return;
+        }
+
+        if (fstat(fileno(fp), &st) != 0) {
+                DIE("Cannot stat file '%s'", filename);
+        }
+
+        memset(&hdr, 0, sizeof(hdr));
+        memcpy(hdr.magic, CHECKPOINT_MAGIC, sizeof(hdr.magic));
+        hdr.options = term_options();
+        hdr.dev = st.st_dev;
+        hdr.ino = st.st_ino;
+        hdr.offset = offset;
+        hdr.head_hash = hash_head(fp, offset);
+        hdr.html = *html;
+        if (index_signature(idx)) {
+                hdr.sig = *index_signature(idx);
+                hdr.have_sig = 1;
+        }
+        hdr.name_len = strlen(filename);
+
+        path = checkpoint_path(dir, filename);
+        if ((tmp_path = (char *) malloc(strlen(path) + 5)) == NULL) {
+                DIE("Cannot malloc memory for checkpoint path");
+        }
+        sprintf(tmp_path, "%s.tmp", path);
+
+        if ((ckpt = fopen(tmp_path, "wb")) == NULL) {
+                DIE("Cannot create checkpoint file '%s'", tmp_path);
+        }
+
+        if (fwrite(&hdr, sizeof(hdr), 1, ckpt) != 1 ||
+            fwrite(filename, 1, hdr.name_len, ckpt) != (size_t) hdr.name_len) {
+                DIE("Cannot write checkpoint file '%s'", tmp_path);
+        }
+        walk_index(idx, save_term, ckpt);
+
+        if (fclose(ckpt) != 0 || rename(tmp_path, path) != 0) {
+                DIE("Cannot write checkpoint file '%s'", path);
+        }
+
+        free(tmp_path);
+        free(path);
+
+        return;
+}
+
+/* Callback for walk_index(); append one term to the checkpoint */
+void save_term(char *w, unsigned int freq, void *arg) {
+        write_run_term((FILE *) arg, w, strlen(w), freq);
+
+        return;
+}
@@ -0,0 +1,21 @@
+/*
+
+  ----------------------------------------------------
+  vsm - vector space model data similarity
+  ----------------------------------------------------
+
+  Copyright (c) 2008 Jason Bittel <jason.bittel@gmail.com>
+ 
+*/
+
+#ifndef _HAVE_CHECKPOINT_H
+#define _HAVE_CHECKPOINT_H
+
+#include "index.h"
+
+/* Number of leading bytes hashed to recognize a replaced file */
+#define CHECKPOINT_HEAD_LEN 4096
+
+void build_index_incremental(INDEX *idx, char *dir, char *filename);
+
+#endif /* ! _HAVE_CHECKPOINT_H */
@@ -0,0 +1,190 @@
+/*
+
+  ----------------------------------------------------
+  vsm - vector space model data similarity
+  ----------------------------------------------------
+
+  Copyright (c) 2008 Jason Bittel <jason.bittel@gmail.com>
+
+*/
+
+/*
+  Parallel ingestion of a single large data file. The file is cut into
+  roughly equal byte ranges that start and end on whitespace, each range is
+  tokenized into a private index on its own thread, and the partial indexes
+  are then merged into the caller's index. Since a word never straddles two
+  ranges, the merged index holds exactly the counts a sequential read would
+  produce, with one exception: lines longer than MAX_LINE_LEN - 2 are read
+  in pieces, and when a boundary falls inside such a line the pieces after
+  it are cut at different points than in a sequential read, so words at
+  those cuts may be divided differently. A near-duplicate signature is
+  likewise gathered per chunk and summed, missing only the few shingles
+  that span a boundary.
+*/
+
+#define _XOPEN_SOURCE 600
+#define _FILE_OFFSET_BITS 64
+
+#include <ctype.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include "chunk.h"
+#include "dedup.h"
+#include "error.h"
+#include "index.h"
+#include "tokenize.h"
+
+typedef struct chunk CHUNK;
+struct chunk {
+        char *filename;
+        off_t start, end;         /* Byte range [start, end) of this chunk */
+        INDEX *idx;               /* Thread-local partial index */
+        SIG_STATE sig;            /* Signature of the chunk, if one is wanted */
+        pthread_t thread;
+};
+
+off_t find_boundary(FILE *fp, off_t offset, off_t size);
+void *index_chunk(void *arg);
+
+/* Return the number of pieces filename should be split into; regular
+   files are split so each piece holds at least MIN_CHUNK_SIZE bytes */
+int count_chunks(char *filename, int num_threads) {
+        struct stat st;
+        off_t num_chunks;
+
+        /* HTML state can't be recovered at an arbitrary offset */
+        if (num_threads < 2 || do_html) return 1;
+        if (stat(filename, &st) != 0 || !S_ISREG(st.st_mode)) return 1;
+
+        num_chunks = st.st_size / MIN_CHUNK_SIZE;
+        if (num_chunks < 1) return 1;
+        if (num_chunks > num_threads) return num_threads;
+
+        return (int) num_chunks;
+}
+
+/* Build the index for filename using num_chunks concurrent threads */
+void build_index_chunked(INDEX *idx, char *filename, int num_chunks) {
+        CHUNK *chunks;
+        FILE *fp;
+        struct stat st;
+        off_t offset;
+        size_t mem_limit;
+        int i;
+
+#ifdef DEBUG
+        ASSERT(num_chunks > 0);
+#endif
+
+        if ((fp = fopen(filename, "r")) == NULL) {
+                DIE("\nCannot open file '%s'", filename);
+        }
+        if (fstat(fileno(fp), &st) != 0) {
+                DIE("Cannot stat file '%s'", filename);
+        }
+
+        if ((chunks = (CHUNK *) calloc(num_chunks, sizeof(CHUNK))) == NULL) {
+                DIE("Cannot calloc memory for chunk array");
+        }
+
+        /* Place each boundary on the first whitespace at or after its
+           nominal offset so no word is divided between two chunks */
+        offset = 0;
+        for (i = 0; i < num_chunks; i++) {
+                chunks[i].filename = filename;
+                chunks[i].start = offset;
+                if (i == num_chunks - 1) {
+                        offset = st.st_size;
+                } else {
+                        offset = find_boundary(fp, st.st_size / num_chunks * (i + 1), st.st_size);
+                        if (offset < chunks[i].start) offset = chunks[i].start;
+                }
+                chunks[i].end = offset;
+        }
+        fclose(fp);
+
+        PRINT("Splitting data file into %d chunks", num_chunks);
+
+        /* The first chunk is handled on the calling thread, directly
+           into the final index; any memory limit is shared evenly */
+        mem_limit = get_memory_limit(idx);
+        set_memory_limit(idx, mem_limit / num_chunks);
+
+        chunks[0].idx = idx;
+        for (i = 1; i < num_chunks; i++) {
+                chunks[i].idx = create_index();
+                isolate_index(chunks[i].idx);
+                set_memory_limit(chunks[i].idx, mem_limit / num_chunks);
+                if (index_signature(idx)) {
+                        init_signature(&chunks[i].sig);
+                        sign_index(chunks[i].idx, &chunks[i].sig);
+                }
+                if (pthread_create(&chunks[i].thread, NULL, index_chunk, &chunks[i]) != 0) {
+                        DIE("Cannot create thread for chunk %d", i);
+                }
+        }
+        index_chunk(&chunks[0]);
+
+        for (i = 1; i < num_chunks; i++) {
+                pthread_join(chunks[i].thread, NULL);
+                merge_index(idx, chunks[i].idx);
+                if (index_signature(idx)) merge_signature(index_signature(idx), &chunks[i].sig);
+                destroy_index(chunks[i].idx);
+        }
+        set_memory_limit(idx, mem_limit);
+
+        free(chunks);
+
+        return;
+}
+
+/* Return the offset just past the first whitespace character at or
+   after offset, or size if there is none */
+off_t find_boundary(FILE *fp, off_t offset, off_t size) {
+        int c;
+
+        if (fseeko(fp, offset, SEEK_SET) != 0) return size;
+
+        while ((c = getc(fp)) != EOF) {
+                offset++;
+                if (isspace(c)) return offset;
+        }
+
+        return size;
+}
+
+/* Thread entry point; tokenize the byte range of one chunk into its index */
+void *index_chunk(void *arg) {
+        CHUNK *chunk = (CHUNK *) arg;
+        FILE *fp;
+        char buf[MAX_LINE_LEN];
+        char *line;
+        off_t pos, len;
+
+        if ((fp = fopen(chunk->filename, "r")) == NULL) {
+                DIE("\nCannot open file '%s'", chunk->filename);
+        }
+        if (fseeko(fp, chunk->start, SEEK_SET) != 0) {
+                DIE("Cannot seek in file '%s'", chunk->filename);
+        }
+
+        pos = chunk->start;
+        while (pos < chunk->end && (line = fgets(buf, sizeof(buf) - 1, fp))) {
+                len = strlen(line);
+
+                /* Clip a line that runs past the end of the chunk; the
+                   boundary is whitespace so nothing is lost */
+                if (pos + len > chunk->end) line[chunk->end - pos] = '\0';
+                pos += len;
+
+                tokenize_line(chunk->idx, line);
+        }
+
+        fclose(fp);
+
+        return NULL;
+}
@@ -0,0 +1,22 @@
+/*
+
+  ----------------------------------------------------
+  vsm - vector space model data similarity
+  ----------------------------------------------------
+
+  Copyright (c) 2008 Jason Bittel <jason.bittel@gmail.com>
+ 
+*/
+
+#ifndef _HAVE_CHUNK_H
+#define _HAVE_CHUNK_H
+
+#include "index.h"
+
+/* Files smaller than this are never split */
+#define MIN_CHUNK_SIZE (8 * 1024 * 1024)
+
+int count_chunks(char *filename, int num_threads);
+void build_index_chunked(INDEX *idx, char *filename, int num_chunks);
+
+#endif /* ! _HAVE_CHUNK_H */
@@ -0,0 +1,369 @@
+/*
+
+  ----------------------------------------------------
+  vsm - vector space model data similarity
+  ----------------------------------------------------
+
+  Copyright (c) 2008 Jason Bittel <jason.bittel@gmail.com>
+
+*/
+
+/*
+  In-process decompression of gzip and zstd data files. Compressed files
+  are recognized by their magic bytes rather than their names. A producer
+  thread inflates the file into a bounded ring of blocks while the calling
+  thread cuts the blocks into lines and tokenizes them, so decompression
+  and tokenization overlap; the producer blocks once every slot is full,
+  so memory use does not depend on the size of the file.
+
+  Concatenated gzip members are read as one stream and anything after the
+  last complete member is warned about and ignored, as gzip itself does.
+  Data on STDIN is recognized the same way, from bytes already read off it.
+  zstd support needs libzstd and is only built with HAVE_ZSTD defined (see
+  the Makefile); otherwise zstd files are recognized but rejected.
+*/
+
+#define _XOPEN_SOURCE 600
+#define _FILE_OFFSET_BITS 64
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+#include "decompress.h"
+#include "error.h"
+#include "html.h"
+#include "index.h"
+#include "tokenize.h"
+
+typedef struct stream STREAM;
+struct stream {
+        char *filename;
+        int format;
+        FILE *fp;                 /* Compressed input, if not in memory */
+        char *src;                /* Compressed input already read ahead */
+        size_t src_len, src_pos;
+        unsigned char *in;        /* Input buffer when reading from fp */
+        char *blocks;             /* DECOMPRESS_SLOTS decompressed blocks */
+        size_t lens[DECOMPRESS_SLOTS];
+        int head, count, done;
+        unsigned long long total;
+        pthread_mutex_t lock;
+        pthread_cond_t not_full, not_empty;
+};
+
+void *decompress_stream(void *arg);
+void inflate_gzip(STREAM *s);
+void inflate_zstd(STREAM *s);
+size_t next_input(STREAM *s, unsigned char **in);
+char *claim_block(STREAM *s);
+void commit_block(STREAM *s, size_t len);
+char *next_block(STREAM *s, size_t *len);
+void release_block(STREAM *s);
+
+/* Identify the compression format of a data file from its first bytes;
+   if buf is given it holds the file contents already read ahead */
+int detect_compression(char *filename, char *buf, size_t len) {
+        unsigned char magic[4];
+        FILE *fp;
+
+        if (buf) {
+                if (len > sizeof(magic)) len = sizeof(magic);
+                memcpy(magic, buf, len);
+        } else {
+                if ((fp = fopen(filename, "rb")) == NULL) return COMPRESS_NONE;
+                len = fread(magic, 1, sizeof(magic), fp);
+                fclose(fp);
+        }
+
+        if (len >= 2 && magic[0] == 0x1f && magic[1] == 0x8b) return COMPRESS_GZIP;
+        if (len >= 4 && magic[0] == 0x28 && magic[1] == 0xb5 &&
+            magic[2] == 0x2f && magic[3] == 0xfd) return COMPRESS_ZSTD;
+
+        return COMPRESS_NONE;
+}
+
+/* Build the index for a compressed file, decompressing it on a second
+   thread; lines are cut exactly as fgets() would cut the uncompressed data
+   with a MAX_LINE_LEN buffer. If buf is given it holds the file contents
+   already read ahead; with no filename the data is read from STDIN, after
+   the len bytes at buf that were already read from it */
+void build_index_compressed(INDEX *idx, char *filename, char *buf, size_t len, int format) {
+        STREAM s;
+        HTML_STATE html;
+        pthread_t producer;
+        char line[MAX_LINE_LEN];
+        char *block, *p, *end, *nl;
+        size_t block_len, take, n = 0;
+
+        memset(&s, 0, sizeof(s));
+        s.filename = (filename) ? filename : "STDIN";
+#ifndef HAVE_ZSTD
+        if (format == COMPRESS_ZSTD) {
+                DIE("Cannot read zstd compressed file '%s'; vsm was built without zstd support", s.filename);
+        }
+#endif
+
+        PRINT("Decompressing %s data", (format == COMPRESS_GZIP) ? "gzip" : "zstd");
+
+        s.format = format;
+        s.src = buf;
+        s.src_len = len;
+        if (!filename) {
+                s.fp = stdin;
+        } else if (!buf && (s.fp = fopen(filename, "rb")) == NULL) {
+                DIE("\nCannot open file '%s'", filename);
+        }
+        if (s.fp) {
+                if ((s.in = (unsigned char *) malloc(DECOMPRESS_BLOCK_SIZE)) == NULL) {
+                        DIE("Cannot malloc memory for compressed input");
+                }
+        }
+        if ((s.blocks = (char *) malloc(DECOMPRESS_SLOTS * DECOMPRESS_BLOCK_SIZE)) == NULL) {
+                DIE("Cannot malloc memory for decompression buffers");
+        }
+        pthread_mutex_init(&s.lock, NULL);
+        pthread_cond_init(&s.not_full, NULL);
+        pthread_cond_init(&s.not_empty, NULL);
+
+        if (pthread_create(&producer, NULL, decompress_stream, &s) != 0) {
+                DIE("Cannot create decompression thread");
+        }
+
+        init_html(&html);
+        while ((block = next_block(&s, &block_len))) {
+                for (p = block, end = block + block_len; p < end; p += take) {
+                        take = end - p;
+                        if (take > MAX_LINE_LEN - 2 - n) take = MAX_LINE_LEN - 2 - n;
+                        if ((nl = memchr(p, '\n', take))) take = nl - p + 1;
+
+                        memcpy(line + n, p, take);
+                        n += take;
+
+                        if (nl || n == MAX_LINE_LEN - 2) {
+                                line[n] = '\0';
+                                if (do_html) strip_html(&html, line);
+                                tokenize_line(idx, line);
+                                n = 0;
+                        }
+                }
+                release_block(&s);
+        }
+        if (n > 0) {
+                line[n] = '\0';
+                if (do_html) strip_html(&html, line);
+                tokenize_line(idx, line);
+        }
+
+        pthread_join(producer, NULL);
+
+        pthread_cond_destroy(&s.not_empty);
+        pthread_cond_destroy(&s.not_full);
+        pthread_mutex_destroy(&s.lock);
+        free(s.blocks);
+        free(s.in);
+        if (s.fp && s.fp != stdin) fclose(s.fp);
+
+        PRINT("Decompressed to %llu bytes", s.total);
+
+        return;
+}
+
+/* Producer thread entry point; decompress the whole input into the ring
+   and then mark the stream done */
+void *decompress_stream(void *arg) {
+        STREAM *s = (STREAM *) arg;
+
+        if (s->format == COMPRESS_GZIP) inflate_gzip(s);
+        else inflate_zstd(s);
+
+        pthread_mutex_lock(&s->lock);
+        s->done = 1;
+        pthread_cond_signal(&s->not_empty);
+        pthread_mutex_unlock(&s->lock);
+
+        return NULL;
+}
+
+/* Inflate gzip input, including any further members that follow the
+   first; input that ends partway through a member, or that continues past
+   the last member with something else, is warned about */
+void inflate_gzip(STREAM *s) {
+        z_stream z;
+        unsigned char *in;
+        size_t n;
+        int ret, full, ended = 0, trailing = 0;
+
+        memset(&z, 0, sizeof(z));
+        if (inflateInit2(&z, 15 + 16) != Z_OK) {
+                DIE("Cannot initialize gzip decompression");
+        }
+
+        z.next_out = (unsigned char *) claim_block(s);
+        z.avail_out = DECOMPRESS_BLOCK_SIZE;
+        while (!trailing && (n = next_input(s, &in)) > 0) {
+                z.next_in = in;
+                z.avail_in = n;
+
+                do {
+                        ret = inflate(&z, Z_NO_FLUSH);
+                        if (ret == Z_STREAM_END) {
+                                ended = 1;
+                                inflateReset(&z);
+                        } else if (ret == Z_OK) {
+                                ended = 0;
+                        } else if (ret != Z_BUF_ERROR && ended) {
+                                /* Not another member; keep what was decoded */
+                                WARN("Ignoring trailing data after the compressed data in '%s'", s->filename);
+                                trailing = 1;
+                                break;
+                        } else if (ret != Z_BUF_ERROR) {
+                                DIE("Corrupt gzip data in '%s': %s", s->filename, (z.msg) ? z.msg : "unknown error");
+                        }
+
+                        if ((full = (z.avail_out == 0))) {
+                                commit_block(s, DECOMPRESS_BLOCK_SIZE);
+                                z.next_out = (unsigned char *) claim_block(s);
+                                z.avail_out = DECOMPRESS_BLOCK_SIZE;
+                        }
+                } while (z.avail_in > 0 || full);
+        }
+        commit_block(s, DECOMPRESS_BLOCK_SIZE - z.avail_out);
+
+        if (!ended) WARN("Compressed data in '%s' is truncated", s->filename);
+        inflateEnd(&z);
+
+        return;
+}
+
+/* Decompress zstd input, including any further frames that follow the
+   first */
+void inflate_zstd(STREAM *s) {
+#ifdef HAVE_ZSTD
+        ZSTD_DStream *ds;
+        ZSTD_inBuffer zin;
+        ZSTD_outBuffer zout;
+        unsigned char *in;
+        size_t n, ret = 1;
+        int full;
+
+        if ((ds = ZSTD_createDStream()) == NULL || ZSTD_isError(ZSTD_initDStream(ds))) {
+                DIE("Cannot initialize zstd decompression");
+        }
+
+        zout.dst = claim_block(s);
+        zout.size = DECOMPRESS_BLOCK_SIZE;
+        zout.pos = 0;
+        while ((n = next_input(s, &in)) > 0) {
+                zin.src = in;
+                zin.size = n;
+                zin.pos = 0;
+
+                do {
+                        ret = ZSTD_decompressStream(ds, &zout, &zin);
+                        if (ZSTD_isError(ret)) {
+                                DIE("Corrupt zstd data in '%s': %s", s->filename, ZSTD_getErrorName(ret));
+                        }
+
+                        if ((full = (zout.pos == zout.size))) {
+                                commit_block(s, zout.pos);
+                                zout.dst = claim_block(s);
+                                zout.pos = 0;
+                        }
+                } while (zin.pos < zin.size || full);
+        }
+        commit_block(s, zout.pos);
+
+        /* A return of 0 means the last frame was completely decoded */
+        if (ret != 0) WARN("Compressed data in '%s' is truncated", s->filename);
+        ZSTD_freeDStream(ds);
+#else
+        (void) s;
+#endif
+
+        return;
+}
+
+/* Point in at the next piece of compressed input, returning its length
+   or 0 at the end of the input */
+size_t next_input(STREAM *s, unsigned char **in) {
+        size_t n;
+
+        if (s->src_pos < s->src_len) {
+                n = s->src_len - s->src_pos;
+                if (n > DECOMPRESS_BLOCK_SIZE) n = DECOMPRESS_BLOCK_SIZE;
+                *in = (unsigned char *) s->src + s->src_pos;
+                s->src_pos += n;
+
+                return n;
+        }
+        if (!s->fp) return 0;
+
+        n = fread(s->in, 1, DECOMPRESS_BLOCK_SIZE, s->fp);
+        if (n == 0 && ferror(s->fp)) DIE("Cannot read from file '%s'", s->filename);
+        *in = s->in;
+
+        return n;
+}
+
+/* Wait for a free slot and return its block for the producer to fill */
+char *claim_block(STREAM *s) {
+        int slot;
+
+        pthread_mutex_lock(&s->lock);
+        while (s->count == DECOMPRESS_SLOTS) {
+                pthread_cond_wait(&s->not_full, &s->lock);
+        }
+        slot = (s->head + s->count) % DECOMPRESS_SLOTS;
+        pthread_mutex_unlock(&s->lock);
+
+        return s->blocks + (size_t) slot * DECOMPRESS_BLOCK_SIZE;
+}
+
+/* Hand the block last claimed by the producer to the consumer; empty
+   blocks are not queued */
+void commit_block(STREAM *s, size_t len) {
+        if (len == 0) return;
+
+        pthread_mutex_lock(&s->lock);
+        s->lens[(s->head + s->count) % DECOMPRESS_SLOTS] = len;
+        s->count++;
+        s->total += len;
+        pthread_cond_signal(&s->not_empty);
+        pthread_mutex_unlock(&s->lock);
+
+        return;
+}
+
+/* Wait for the next decompressed block; returns NULL once the producer
+   is done and every block has been consumed */
+char *next_block(STREAM *s, size_t *len) {
+        char *block = NULL;
+
+        pthread_mutex_lock(&s->lock);
+        while (s->count == 0 && !s->done) {
+                pthread_cond_wait(&s->not_empty, &s->lock);
+        }
+        if (s->count > 0) {
+                block = s->blocks + (size_t) s->head * DECOMPRESS_BLOCK_SIZE;
+                *len = s->lens[s->head];
+        }
+        pthread_mutex_unlock(&s->lock);
+
+        return block;
+}
+
+/* Return the block last taken by the consumer to the producer */
+void release_block(STREAM *s) {
+        pthread_mutex_lock(&s->lock);
+        s->head = (s->head + 1) % DECOMPRESS_SLOTS;
+        s->count--;
+        pthread_cond_signal(&s->not_full);
+        pthread_mutex_unlock(&s->lock);
+
+        return;
+}
@@ -0,0 +1,29 @@
+/*
+
+  ----------------------------------------------------
+  vsm - vector space model data similarity
+  ----------------------------------------------------
+
+  Copyright (c) 2008 Jason Bittel <jason.bittel@gmail.com>
+
+*/
+
+#ifndef _HAVE_DECOMPRESS_H
+#define _HAVE_DECOMPRESS_H
+
+#include <stddef.h>
+#include "index.h"
+
+#define COMPRESS_NONE 0
+#define COMPRESS_GZIP 1
+#define COMPRESS_ZSTD 2
+
+/* Decompressed data is passed from the producer thread to the tokenizer
+   in a ring of DECOMPRESS_SLOTS blocks of DECOMPRESS_BLOCK_SIZE bytes */
+#define DECOMPRESS_SLOTS 4
+#define DECOMPRESS_BLOCK_SIZE (256 * 1024)
+
+int detect_compression(char *filename, char *buf, size_t len);
+void build_index_compressed(INDEX *idx, char *filename, char *buf, size_t len, int format);
+
+#endif /* ! _HAVE_DECOMPRESS_H */
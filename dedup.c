@@ -0,0 +1,304 @@
+/*
+
+  ----------------------------------------------------
+  vsm - vector space model data similarity
+  ----------------------------------------------------
+
+  Copyright (c) 2008 Jason Bittel <jason.bittel@gmail.com>
+
+*/
+
+/*
+  Near-duplicate detection using 64 bit SimHash signatures. Every run of
+  SHINGLE_LEN consecutive words in a document is hashed, and each bit of
+  the signature is set when more of the shingle hashes have that bit set
+  than clear. Documents sharing most of their text therefore differ in only
+  a few signature bits, so a small Hamming distance marks a near-duplicate
+  whose earlier score can be reused. Hashing shingles rather than single
+  words keeps common words from dominating every signature, and documents
+  too short to hold a single shingle have no signature and are always
+  scored.
+
+  The signature is fed from the same lines that build the index: the
+  tokenizer hands each normalized line, before stop word removal and
+  stemming, to the signature of the index being built (see sign_index()),
+  so a file is read only once whether or not it is checked.
+
+  Signatures are found again through SimHash tables: the 64 bits are split
+  into SIG_BANDS bands, and since two signatures within
+  MAX_SIGNATURE_DISTANCE bits of each other must agree exactly in at least
+  one band, only the signatures sharing a band with the new one need to be
+  compared.
+
+  Signatures may also be kept in a store file across runs. The store
+  records a fingerprint of the query and options it was scored with, as
+  reused scores are only meaningful for the same query.
+*/
+
+#define SIG_BLOCKSIZE 100
+#define SIG_BANDS (MAX_SIGNATURE_DISTANCE + 1)
+#define BAND_BITS (SIG_BITS / SIG_BANDS)
+#define BAND(sig, b) ((int) ((sig) >> ((b) * BAND_BITS) & ((1ULL << BAND_BITS) - 1)))
+#define FNV_OFFSET 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dedup.h"
+#include "error.h"
+#include "tokenize.h"
+
+static DUPLICATE *signatures = NULL;
+static int num_signatures = 0;
+static FILE *store = NULL;
+static int num_scores = 1;
+
+/* SimHash tables: for each band, the latest signature with each value of
+   the band, and for each signature, the previous one sharing it; -1 ends
+   a chain */
+static int *band_heads[SIG_BANDS];
+static int *band_next = NULL;
+
+DUPLICATE *append_signature(SIGNATURE sig, float *scores, char *name);
+
+/* FNV-1a hash of a single word */
+SIGNATURE hash_word(char *w, int len) {
+        SIGNATURE h = FNV_OFFSET;
+
+        while (len-- > 0) {
+                h ^= (unsigned char) *w++;
+                h *= FNV_PRIME;
+        }
+
+        return h;
+}
+
+/* Hash a NULL terminated list of terms in order; used to fingerprint
+   the query a signature store belongs to */
+SIGNATURE hash_terms(char **terms) {
+        SIGNATURE h = FNV_OFFSET;
+
+        for (; *terms; terms++) {
+                h ^= hash_word(*terms, strlen(*terms));
+                h *= FNV_PRIME;
+        }
+
+        return h;
+}
+
+/* Begin the signature of a new document */
+void init_signature(SIG_STATE *state) {
+        memset(state, 0, sizeof(SIG_STATE));
+
+        return;
+}
+
+/* Add the hash of every shingle ending in a normalized line to the per-bit
+   weights; shingles continue across lines. The line is left unchanged */
+void sign_words(SIG_STATE *state, char *line) {
+        SIGNATURE h;
+        char *end;
+        int i;
+
+        for (; *line; line = end + (*end == ' ')) {
+                for (end = line; *end && *end != ' '; end++);
+
+                memmove(state->words, state->words + 1, (SHINGLE_LEN - 1) * sizeof(SIGNATURE));
+                state->words[SHINGLE_LEN - 1] = hash_word(line, end - line);
+                if (state->num_words < SHINGLE_LEN && ++state->num_words < SHINGLE_LEN) continue;
+
+                for (h = FNV_OFFSET, i = 0; i < SHINGLE_LEN; i++) {
+                        h = (h ^ state->words[i]) * FNV_PRIME;
+                }
+                for (i = 0; i < SIG_BITS; i++) {
+                        state->weights[i] += ((h >> i) & 1) ? 1 : -1;
+                }
+                state->num_shingles++;
+        }
+
+        return;
+}
+
+/* Add the shingles of src, signed over a later piece of the same document,
+   to dst; the few shingles spanning the two pieces are not counted */
+void merge_signature(SIG_STATE *dst, SIG_STATE *src) {
+        int i;
+
+        for (i = 0; i < SIG_BITS; i++) {
+                dst->weights[i] += src->weights[i];
+        }
+        memcpy(dst->words, src->words, sizeof(dst->words));
+        dst->num_words = src->num_words;
+        dst->num_shingles += src->num_shingles;
+
+        return;
+}
+
+/* Collapse the per-bit weights into sig; returns 0 if no shingle was
+   hashed, as every such document would share the same signature */
+int fold_signature(SIG_STATE *state, SIGNATURE *sig) {
+        int i;
+
+        if (state->num_shingles == 0) return 0;
+
+        *sig = 0;
+        for (i = 0; i < SIG_BITS; i++) {
+                if (state->weights[i] > 0) *sig |= (SIGNATURE) 1 << i;
+        }
+
+        return 1;
+}
+
+/* Load the signatures held in a store file, creating it if necessary;
+   new signatures are appended to the store as they are added. Each
+   entry holds count scores, one for each scoring model */
+void open_signature_store(char *filename, SIGNATURE fingerprint, int count) {
+        char buf[MAX_LINE_LEN];
+        unsigned long long sig, stored;
+        float scores[MAX_MODELS];
+        char *p;
+        int i, pos;
+        FILE *fp;
+
+        num_scores = count;
+
+        if ((fp = fopen(filename, "r")) != NULL) {
+                if (!fgets(buf, sizeof(buf), fp) ||
+                    sscanf(buf, "# vsm signatures %llx", &stored) != 1) {
+                        DIE("'%s' is not a signature store", filename);
+                }
+                if (stored != fingerprint) {
+                        DIE("Signature store '%s' was built for a different query", filename);
+                }
+
+                while (fgets(buf, sizeof(buf), fp)) {
+                        buf[strcspn(buf, "\n")] = '\0';
+                        if (sscanf(buf, "%llx %n", &sig, &pos) < 1) continue;
+                        for (p = buf + pos, i = 0; i < num_scores; i++, p += pos) {
+                                if (sscanf(p, "%f %n", &scores[i], &pos) < 1) break;
+                        }
+                        if (i < num_scores) continue;
+                        append_signature(sig, scores, p);
+                }
+
+                fclose(fp);
+
+                if ((store = fopen(filename, "a")) == NULL) {
+                        DIE("Cannot open signature store '%s' for writing", filename);
+                }
+        } else {
+                if ((store = fopen(filename, "w")) == NULL) {
+                        DIE("Cannot create signature store '%s'", filename);
+                }
+                fprintf(store, "# vsm signatures %016llx\n", fingerprint);
+        }
+
+        PRINT("Loaded %d signatures from '%s'", num_signatures, filename);
+
+        return;
+}
+
+/* Return the closest earlier document within MAX_SIGNATURE_DISTANCE
+   bits of sig, the earliest of any that are equally close, or NULL if
+   there is none */
+DUPLICATE *find_duplicate(SIGNATURE sig) {
+        int b, i, dist, best = -1, best_dist = MAX_SIGNATURE_DISTANCE + 1;
+
+        if (num_signatures == 0) return NULL;
+
+        for (b = 0; b < SIG_BANDS; b++) {
+                for (i = band_heads[b][BAND(sig, b)]; i >= 0; i = band_next[i * SIG_BANDS + b]) {
+                        dist = __builtin_popcountll(signatures[i].sig ^ sig);
+                        if (dist < best_dist || (dist == best_dist && i < best)) {
+                                best = i;
+                                best_dist = dist;
+                        }
+                }
+        }
+
+        return (best >= 0) ? &signatures[best] : NULL;
+}
+
+/* Remember the signature and scores of a newly scored document */
+void add_signature(SIGNATURE sig, float *scores, char *name) {
+        int i;
+
+        append_signature(sig, scores, name);
+
+        if (store) {
+                fprintf(store, "%016llx", sig);
+                for (i = 0; i < num_scores; i++) {
+                        fprintf(store, " %.4f", scores[i]);
+                }
+                fprintf(store, " %s\n", name);
+        }
+
+        return;
+}
+
+/* Append a signature to the in-memory list and its SimHash tables */
+DUPLICATE *append_signature(SIGNATURE sig, float *scores, char *name) {
+        DUPLICATE *tmp, *d;
+        int *links;
+        int b, i;
+
+        if (!band_heads[0]) {
+                for (b = 0; b < SIG_BANDS; b++) {
+                        if ((band_heads[b] = (int *) malloc((1 << BAND_BITS) * sizeof(int))) == NULL) {
+                                DIE("Cannot malloc memory for signature table");
+                        }
+                        for (i = 0; i < 1 << BAND_BITS; i++) band_heads[b][i] = -1;
+                }
+        }
+
+        if (num_signatures % SIG_BLOCKSIZE == 0) {
+                tmp = realloc(signatures, (num_signatures + SIG_BLOCKSIZE) * sizeof(DUPLICATE));
+                links = realloc(band_next, (num_signatures + SIG_BLOCKSIZE) * SIG_BANDS * sizeof(int));
+                if (!tmp || !links) {
+                        DIE("Cannot realloc memory for signature array");
+                }
+                signatures = tmp;
+                band_next = links;
+        }
+
+        d = &signatures[num_signatures];
+        if ((d->name = (char *) malloc(strlen(name) + 1)) == NULL) {
+                DIE("Cannot malloc memory for signature name");
+        }
+        strcpy(d->name, name);
+        d->sig = sig;
+        memcpy(d->scores, scores, num_scores * sizeof(float));
+
+        for (b = 0; b < SIG_BANDS; b++) {
+                band_next[num_signatures * SIG_BANDS + b] = band_heads[b][BAND(sig, b)];
+                band_heads[b][BAND(sig, b)] = num_signatures;
+        }
+        num_signatures++;
+
+        return d;
+}
+
+/* Free all signatures and close the store */
+void destroy_signatures() {
+        int b, i;
+
+        for (i = 0; i < num_signatures; i++) {
+                free(signatures[i].name);
+        }
+        free(signatures);
+        signatures = NULL;
+        num_signatures = 0;
+
+        for (b = 0; b < SIG_BANDS; b++) {
+                free(band_heads[b]);
+                band_heads[b] = NULL;
+        }
+        free(band_next);
+        band_next = NULL;
+
+        if (store) fclose(store);
+        store = NULL;
+
+        return;
+}
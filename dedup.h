@@ -0,0 +1,53 @@
+/*
+
+  ----------------------------------------------------
+  vsm - vector space model data similarity
+  ----------------------------------------------------
+
+  Copyright (c) 2008 Jason Bittel <jason.bittel@gmail.com>
+ 
+*/
+
+#ifndef _HAVE_DEDUP_H
+#define _HAVE_DEDUP_H
+
+#include <stddef.h>
+#include "score.h"
+
+/* Documents whose signatures differ in at most this many bits are
+   considered near-duplicates */
+#define MAX_SIGNATURE_DISTANCE 3
+
+#define SIG_BITS 64
+#define SHINGLE_LEN 3
+
+typedef unsigned long long SIGNATURE;
+
+/* Signature of a document in progress, fed its words as it is tokenized */
+typedef struct sig_state SIG_STATE;
+struct sig_state {
+        int weights[SIG_BITS];
+        SIGNATURE words[SHINGLE_LEN];     /* Hashes of the most recent words */
+        int num_words;                    /* Words held in words, at most SHINGLE_LEN */
+        int num_shingles;
+};
+
+typedef struct duplicate DUPLICATE;
+struct duplicate {
+        SIGNATURE sig;
+        float scores[MAX_MODELS];         /* One per scoring model */
+        char *name;
+};
+
+SIGNATURE hash_word(char *w, int len);
+SIGNATURE hash_terms(char **terms);
+void init_signature(SIG_STATE *state);
+void sign_words(SIG_STATE *state, char *line);
+void merge_signature(SIG_STATE *dst, SIG_STATE *src);
+int fold_signature(SIG_STATE *state, SIGNATURE *sig);
+void open_signature_store(char *filename, SIGNATURE fingerprint, int num_scores);
+DUPLICATE *find_duplicate(SIGNATURE sig);
+void add_signature(SIGNATURE sig, float *scores, char *name);
+void destroy_signatures();
+
+#endif /* ! _HAVE_DEDUP_H */
@@ -0,0 +1,246 @@
+/*
+
+  ----------------------------------------------------
+  vsm - vector space model data similarity
+  ----------------------------------------------------
+
+  Copyright (c) 2008 Jason Bittel <jason.bittel@gmail.com>
+
+*/
+
+/*
+  Term dictionary mapping each distinct word to a small, dense integer id.
+  A word is hashed and copied into the dictionary the first time it is
+  seen; from then on indexes and queries refer to it only by id, so the
+  same common words are not stored and compared again for every document.
+  Ids are handed out in order starting at zero and stay valid until the
+  dictionary is cleared. Lookups use an open addressed hash table of ids
+  kept at most half full, and the word strings are packed into large
+  blocks rather than allocated one by one.
+*/
+
+#define TERM_BLOCKSIZE 1024
+#define STRING_BLOCKSIZE 65536
+#define MIN_SLOTS 1024
+#define FNV_OFFSET 2166136261U
+#define FNV_PRIME 16777619U
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include "dict.h"
+#include "error.h"
+
+struct dict {
+        char **words;             /* Term strings, by id */
+        int *lens;
+        unsigned int *hashes;
+        int num_terms;
+        int size;                 /* Allocated length of the arrays above */
+        int *slots;               /* Hash table of ids; -1 marks an empty slot */
+        int num_slots;            /* Always a power of two */
+        char **blocks;            /* Blocks holding the term strings */
+        int num_blocks;
+        char *next;               /* Unused space in the newest block */
+        size_t room;
+};
+
+int *find_slot(DICT *d, char *w, int len, unsigned int h);
+void grow_slots(DICT *d);
+char *store_string(DICT *d, char *w, int len);
+
+/* Allocate a new, empty dictionary */
+DICT *create_dict() {
+        DICT *d;
+        int i;
+
+        if ((d = (DICT *) calloc(1, sizeof(DICT))) == NULL) {
+                DIE("Cannot calloc memory for dictionary");
+        }
+
+        if ((d->slots = (int *) malloc(MIN_SLOTS * sizeof(int))) == NULL) {
+                DIE("Cannot malloc memory for dictionary table");
+        }
+        d->num_slots = MIN_SLOTS;
+        for (i = 0; i < d->num_slots; i++) d->slots[i] = -1;
+
+        return d;
+}
+
+/* Return the id of w, adding it to the dictionary if it is new */
+int intern_term(DICT *d, char *w, int len) {
+        return intern_hashed(d, w, len, hash_string(w, len));
+}
+
+/* As intern_term(), for a word whose hash_string() value is already
+   known */
+int intern_hashed(DICT *d, char *w, int len, unsigned int h) {
+        int *slot;
+        int id;
+
+#ifdef DEBUG
+        ASSERT(d && w);
+        ASSERT(h == hash_string(w, len));
+#endif
+
+        slot = find_slot(d, w, len, h);
+        if (*slot >= 0) return *slot;
+
+        if (d->num_terms == d->size) {
+                d->size += TERM_BLOCKSIZE;
+                d->words = (char **) realloc(d->words, d->size * sizeof(char *));
+                d->lens = (int *) realloc(d->lens, d->size * sizeof(int));
+                d->hashes = (unsigned int *) realloc(d->hashes, d->size * sizeof(unsigned int));
+                if (!d->words || !d->lens || !d->hashes) {
+                        DIE("Cannot realloc memory for dictionary terms");
+                }
+        }
+
+        id = d->num_terms++;
+        d->words[id] = store_string(d, w, len);
+        d->lens[id] = len;
+        d->hashes[id] = h;
+        *slot = id;
+
+        if (d->num_terms * 2 > d->num_slots) grow_slots(d);
+
+        return id;
+}
+
+/* Return the id of w, or -1 if it is not in the dictionary */
+int lookup_term(DICT *d, char *w, int len) {
+        return *find_slot(d, w, len, hash_string(w, len));
+}
+
+/* Return the string for a term id */
+char *term_string(DICT *d, int id) {
+#ifdef DEBUG
+        ASSERT(id >= 0 && id < d->num_terms);
+#endif
+
+        return d->words[id];
+}
+
+/* Return the length of the string for a term id */
+int term_length(DICT *d, int id) {
+        return d->lens[id];
+}
+
+/* Return the number of terms in the dictionary, which is also one
+   past the largest id */
+int count_terms(DICT *d) {
+        return d->num_terms;
+}
+
+/* FNV-1a hash of a word */
+unsigned int hash_string(char *w, int len) {
+        unsigned int h = FNV_OFFSET;
+
+        while (len-- > 0) {
+                h ^= (unsigned char) *w++;
+                h *= FNV_PRIME;
+        }
+
+        return h;
+}
+
+/* Return the slot holding w, or the empty slot where it belongs */
+int *find_slot(DICT *d, char *w, int len, unsigned int h) {
+        unsigned int mask = d->num_slots - 1;
+        unsigned int i = h & mask;
+        int id;
+
+        while ((id = d->slots[i]) >= 0) {
+                if (d->hashes[id] == h && d->lens[id] == len && memcmp(d->words[id], w, len) == 0) break;
+                i = (i + 1) & mask;
+        }
+
+        return &d->slots[i];
+}
+
+/* Double the hash table and reinsert every id */
+void grow_slots(DICT *d) {
+        unsigned int mask, i;
+        int id;
+
+        free(d->slots);
+        d->num_slots *= 2;
+        if ((d->slots = (int *) malloc(d->num_slots * sizeof(int))) == NULL) {
+                DIE("Cannot malloc memory for dictionary table");
+        }
+        for (i = 0; i < (unsigned int) d->num_slots; i++) d->slots[i] = -1;
+
+        mask = d->num_slots - 1;
+        for (id = 0; id < d->num_terms; id++) {
+                for (i = d->hashes[id] & mask; d->slots[i] >= 0; i = (i + 1) & mask);
+                d->slots[i] = id;
+        }
+
+        return;
+}
+
+/* Copy a word into the current string block, starting a new block when
+   it does not fit */
+char *store_string(DICT *d, char *w, int len) {
+        char **tmp;
+        char *s;
+        size_t size;
+
+        if (d->room < (size_t) len + 1) {
+                size = ((size_t) len + 1 > STRING_BLOCKSIZE) ? (size_t) len + 1 : STRING_BLOCKSIZE;
+
+                tmp = (char **) realloc(d->blocks, (d->num_blocks + 1) * sizeof(char *));
+                if (!tmp) {
+                        DIE("Cannot realloc memory for dictionary blocks");
+                }
+                d->blocks = tmp;
+
+                if ((d->next = (char *) malloc(size)) == NULL) {
+                        DIE("Cannot malloc memory for dictionary strings");
+                }
+                d->blocks[d->num_blocks++] = d->next;
+                d->room = size;
+        }
+
+        s = d->next;
+        memcpy(s, w, len);
+        s[len] = '\0';
+        d->next += len + 1;
+        d->room -= len + 1;
+
+        return s;
+}
+
+/* Forget every term, invalidating all ids; the string blocks are
+   returned to the OS but the tables are kept for reuse */
+void clear_dict(DICT *d) {
+        int i;
+
+        for (i = 0; i < d->num_blocks; i++) {
+                free(d->blocks[i]);
+        }
+        d->num_blocks = 0;
+        d->next = NULL;
+        d->room = 0;
+
+        for (i = 0; i < d->num_slots; i++) d->slots[i] = -1;
+        d->num_terms = 0;
+
+        return;
+}
+
+/* Release all memory held by the dictionary, including the dictionary
+   itself */
+void destroy_dict(DICT *d) {
+        if (!d) return;
+
+        clear_dict(d);
+        free(d->blocks);
+        free(d->words);
+        free(d->lens);
+        free(d->hashes);
+        free(d->slots);
+        free(d);
+
+        return;
+}
@@ -0,0 +1,29 @@
+/*
+
+  ----------------------------------------------------
+  vsm - vector space model data similarity
+  ----------------------------------------------------
+
+  Copyright (c) 2008 Jason Bittel <jason.bittel@gmail.com>
+
+*/
+
+#ifndef _HAVE_DICT_H
+#define _HAVE_DICT_H
+
+#include <stddef.h>
+
+typedef struct dict DICT;
+
+DICT *create_dict();
+int intern_term(DICT *d, char *w, int len);
+int intern_hashed(DICT *d, char *w, int len, unsigned int h);
+int lookup_term(DICT *d, char *w, int len);
+char *term_string(DICT *d, int id);
+int term_length(DICT *d, int id);
+int count_terms(DICT *d);
+void clear_dict(DICT *d);
+void destroy_dict(DICT *d);
+unsigned int hash_string(char *w, int len);
+
+#endif /* ! _HAVE_DICT_H */
@@ -0,0 +1,339 @@
+/*
+
+  ----------------------------------------------------
+  vsm - vector space model data similarity
+  ----------------------------------------------------
+
+  Copyright (c) 2008 Jason Bittel <jason.bittel@gmail.com>
+
+*/
+
+/*
+  Binary export of document vectors for external tools. Each document
+  scored is appended to a single file as one row of a sparse matrix whose
+  columns are every distinct term seen across the run (see export.h for
+  the layout). Term columns are numbered in order of first appearance in a
+  run-wide dictionary, independent of the dictionaries of the indexes
+  themselves, so rows from spilled and in-memory indexes line up.
+
+  The term column of each entry is written out as each document arrives
+  and its frequencies go to a temporary file; the small per-document
+  columns, names and terms are kept in memory. When the export is closed
+  the frequencies and remaining sections are appended and the header is
+  rewritten with the final counts and offsets. Until then the file is
+  written under a temporary name and only renamed into place once it is
+  complete, so a run that dies early never leaves a valid-looking export
+  behind. Readers can mmap the file and use every section in place.
+*/
+
+#define _XOPEN_SOURCE 600
+#define _FILE_OFFSET_BITS 64
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include "dict.h"
+#include "error.h"
+#include "export.h"
+#include "index.h"
+#include "tokenize.h"
+
+typedef struct entry ENTRY;
+struct entry {
+        unsigned int id;
+        unsigned int freq;
+};
+
+void add_entry(char *w, unsigned int freq, void *arg);
+int compare_entries(const void *a, const void *b);
+void write_section(FILE *fp, void *data, size_t len, unsigned long long *pos);
+void free_export();
+
+static FILE *export_fp = NULL;
+static FILE *freq_fp = NULL;      /* Frequency column until the export is closed */
+static char *export_name = NULL;
+static char *export_tmp = NULL;   /* Name written under until closed */
+static DICT *columns = NULL;
+
+/* Entries of the document being exported */
+static ENTRY *entries = NULL;
+static unsigned int *column = NULL;
+static int doc_entries = 0;
+static int entries_size = 0;
+static unsigned int doc_max_freq;
+static double doc_sum_squares;
+
+/* Per-document columns */
+static unsigned long long *rows = NULL;
+static unsigned int *max_freqs = NULL;
+static float *norms = NULL;
+static unsigned long long *name_offsets = NULL;
+static char *names = NULL;
+static size_t names_len = 0, names_size = 0;
+static unsigned long long num_docs = 0;
+static unsigned long long num_entries = 0;
+
+/* Create the temporary export file and reserve space for its header */
+void open_export(char *filename) {
+        EXPORT_HEADER hdr;
+
+        if ((export_tmp = (char *) malloc(strlen(filename) + 5)) == NULL) {
+                DIE("Cannot malloc memory for export file name");
+        }
+        sprintf(export_tmp, "%s.tmp", filename);
+        if ((export_fp = fopen(export_tmp, "wb")) == NULL) {
+                DIE("Cannot create export file '%s'", export_tmp);
+        }
+        if ((freq_fp = tmpfile()) == NULL) {
+                DIE("Cannot create temporary file for export");
+        }
+
+        memset(&hdr, 0, sizeof(hdr));
+        if (fwrite(&hdr, sizeof(hdr), 1, export_fp) != 1) {
+                DIE("Cannot write export file '%s'", filename);
+        }
+
+        export_name = filename;
+        columns = create_dict();
+        PRINT("Exporting document vectors to '%s'", filename);
+
+        return;
+}
+
+/* Append the term vector of the document in idx as the next row */
+void export_index(INDEX *idx, char *name) {
+        void *tmp;
+        size_t len;
+        int i;
+
+        if (!export_fp) return;
+
+        doc_entries = 0;
+        doc_max_freq = 0;
+        doc_sum_squares = 0;
+        walk_terms(idx, add_entry, NULL);
+        qsort(entries, doc_entries, sizeof(ENTRY), compare_entries);
+
+        for (i = 0; i < doc_entries; i++) column[i] = entries[i].id;
+        if (fwrite(column, sizeof(unsigned int), doc_entries, export_fp) != (size_t) doc_entries) {
+                DIE("Cannot write export file '%s'", export_name);
+        }
+        for (i = 0; i < doc_entries; i++) column[i] = entries[i].freq;
+        if (fwrite(column, sizeof(unsigned int), doc_entries, freq_fp) != (size_t) doc_entries) {
+                DIE("Cannot write temporary export file");
+        }
+
+        /* One extra row pointer and name offset mark the final end */
+        if (num_docs % EXPORT_BLOCKSIZE == 0) {
+                len = num_docs + EXPORT_BLOCKSIZE + 1;
+                if ((tmp = realloc(rows, len * sizeof(unsigned long long))) == NULL) {
+                        DIE("Cannot realloc memory for export rows");
+                }
+                rows = tmp;
+                if ((tmp = realloc(name_offsets, len * sizeof(unsigned long long))) == NULL) {
+                        DIE("Cannot realloc memory for export names");
+                }
+                name_offsets = tmp;
+                if ((tmp = realloc(max_freqs, len * sizeof(unsigned int))) == NULL) {
+                        DIE("Cannot realloc memory for export frequencies");
+                }
+                max_freqs = tmp;
+                if ((tmp = realloc(norms, len * sizeof(float))) == NULL) {
+                        DIE("Cannot realloc memory for export norms");
+                }
+                norms = tmp;
+        }
+
+        len = strlen(name) + 1;
+        if (names_len + len > names_size) {
+                names_size = names_len + len + EXPORT_BLOCKSIZE * 16;
+                if ((tmp = realloc(names, names_size)) == NULL) {
+                        DIE("Cannot realloc memory for export names");
+                }
+                names = tmp;
+        }
+        memcpy(names + names_len, name, len);
+
+        rows[num_docs] = num_entries;
+        max_freqs[num_docs] = doc_max_freq;
+        norms[num_docs] = (doc_max_freq) ? sqrt(doc_sum_squares) / doc_max_freq : 0;
+        name_offsets[num_docs] = names_len;
+
+        names_len += len;
+        num_entries += doc_entries;
+        num_docs++;
+
+        return;
+}
+
+/* Callback for walk_terms(); add one term of the document as an entry */
+void add_entry(char *w, unsigned int freq, void *arg) {
+        void *tmp;
+
+        (void) arg;
+
+        if (doc_entries == entries_size) {
+                entries_size += EXPORT_BLOCKSIZE;
+                if ((tmp = realloc(entries, entries_size * sizeof(ENTRY))) == NULL) {
+                        DIE("Cannot realloc memory for export entries");
+                }
+                entries = tmp;
+                if ((tmp = realloc(column, entries_size * sizeof(unsigned int))) == NULL) {
+                        DIE("Cannot realloc memory for export entries");
+                }
+                column = tmp;
+        }
+
+        entries[doc_entries].id = intern_term(columns, w, strlen(w));
+        entries[doc_entries].freq = freq;
+        doc_entries++;
+
+        if (freq > doc_max_freq) doc_max_freq = freq;
+        doc_sum_squares += (double) freq * freq;
+
+        return;
+}
+
+/* qsort() comparison function for entries, by term column */
+int compare_entries(const void *a, const void *b) {
+        unsigned int x = ((const ENTRY *) a)->id;
+        unsigned int y = ((const ENTRY *) b)->id;
+
+        return (x > y) - (x < y);
+}
+
+/* Write the remaining sections and the final header, close the export
+   file and move it to its final name; safe to call when no export is
+   open */
+void close_export() {
+        EXPORT_HEADER hdr;
+        FILE *fp = export_fp;
+        char buf[BUFSIZ];
+        unsigned long long pos, *term_offsets;
+        size_t n;
+        int i, num_terms;
+
+        /* Cleared first so a failure below doesn't close the file twice */
+        export_fp = NULL;
+        if (!fp) return;
+
+        num_terms = count_terms(columns);
+        if ((term_offsets = (unsigned long long *) malloc((num_terms + 1) * sizeof(unsigned long long))) == NULL) {
+                DIE("Cannot malloc memory for export terms");
+        }
+        for (pos = 0, i = 0; i < num_terms; i++) {
+                term_offsets[i] = pos;
+                pos += term_length(columns, i) + 1;
+        }
+        term_offsets[num_terms] = pos;
+        if (num_docs == 0) {
+                if (!rows) rows = (unsigned long long *) malloc(sizeof(unsigned long long));
+                if (!name_offsets) name_offsets = (unsigned long long *) malloc(sizeof(unsigned long long));
+                if (!rows || !name_offsets) DIE("Cannot malloc memory for export rows");
+        }
+        rows[num_docs] = num_entries;
+        name_offsets[num_docs] = names_len;
+
+        memset(&hdr, 0, sizeof(hdr));
+        memcpy(hdr.magic, EXPORT_MAGIC, sizeof(hdr.magic));
+        hdr.byte_order = EXPORT_BYTE_ORDER;
+        hdr.options = min_len << 3 | do_html << 2 | do_stop_words << 1 | do_stemming;
+        hdr.num_docs = num_docs;
+        hdr.num_terms = num_terms;
+        hdr.num_entries = num_entries;
+
+        /* The term columns were written as documents arrived */
+        hdr.ids = sizeof(hdr);
+        pos = hdr.ids + num_entries * sizeof(unsigned int);
+        write_section(fp, NULL, 0, &pos);
+
+        hdr.freqs = pos;
+        rewind(freq_fp);
+        while ((n = fread(buf, 1, sizeof(buf), freq_fp)) > 0) {
+                if (fwrite(buf, 1, n, fp) != n) DIE("Cannot write export file '%s'", export_name);
+                pos += n;
+        }
+        write_section(fp, NULL, 0, &pos);
+
+        hdr.rows = pos;
+        write_section(fp, rows, (num_docs + 1) * sizeof(unsigned long long), &pos);
+        hdr.max_freqs = pos;
+        write_section(fp, max_freqs, num_docs * sizeof(unsigned int), &pos);
+        hdr.norms = pos;
+        write_section(fp, norms, num_docs * sizeof(float), &pos);
+        hdr.name_offsets = pos;
+        write_section(fp, name_offsets, (num_docs + 1) * sizeof(unsigned long long), &pos);
+        hdr.names = pos;
+        write_section(fp, names, names_len, &pos);
+        hdr.term_offsets = pos;
+        write_section(fp, term_offsets, (num_terms + 1) * sizeof(unsigned long long), &pos);
+        hdr.terms = pos;
+        for (i = 0; i < num_terms; i++) {
+                write_section(fp, term_string(columns, i), term_length(columns, i) + 1, NULL);
+        }
+        pos += term_offsets[num_terms];
+        write_section(fp, NULL, 0, &pos);
+
+        if (fseeko(fp, 0, SEEK_SET) != 0 || fwrite(&hdr, sizeof(hdr), 1, fp) != 1 || fclose(fp) != 0) {
+                DIE("Cannot write export file '%s'", export_name);
+        }
+        if (rename(export_tmp, export_name) != 0) {
+                DIE("Cannot rename export file '%s' to '%s'", export_tmp, export_name);
+        }
+        PRINT("Exported %llu documents with %d distinct terms to '%s'", num_docs, num_terms, export_name);
+
+        free(term_offsets);
+        free_export();
+
+        return;
+}
+
+/* Write len bytes of data, then pad the file to a multiple of 8 bytes;
+   pos tracks the file offset and is left unpadded if NULL */
+void write_section(FILE *fp, void *data, size_t len, unsigned long long *pos) {
+        static char zeros[8];
+        size_t pad;
+
+        if (len > 0 && fwrite(data, 1, len, fp) != len) {
+                DIE("Cannot write export file '%s'", export_name);
+        }
+        if (!pos) return;
+
+        *pos += len;
+        pad = (8 - *pos % 8) % 8;
+        if (pad > 0 && fwrite(zeros, 1, pad, fp) != pad) {
+                DIE("Cannot write export file '%s'", export_name);
+        }
+        *pos += pad;
+
+        return;
+}
+
+/* Release the export buffers */
+void free_export() {
+        if (freq_fp) fclose(freq_fp);
+        freq_fp = NULL;
+        if (columns) destroy_dict(columns);
+        columns = NULL;
+
+        free(entries);
+        free(column);
+        free(rows);
+        free(max_freqs);
+        free(norms);
+        free(name_offsets);
+        free(names);
+        free(export_tmp);
+        entries = NULL;
+        column = NULL;
+        rows = NULL;
+        max_freqs = NULL;
+        norms = NULL;
+        name_offsets = NULL;
+        names = NULL;
+        export_tmp = NULL;
+
+        return;
+}
@@ -0,0 +1,54 @@
+/*
+
+  ----------------------------------------------------
+  vsm - vector space model data similarity
+  ----------------------------------------------------
+
+  Copyright (c) 2008 Jason Bittel <jason.bittel@gmail.com>
+
+*/
+
+#ifndef _HAVE_EXPORT_H
+#define _HAVE_EXPORT_H
+
+#include "index.h"
+
+#define EXPORT_MAGIC "VSMVEC1"
+#define EXPORT_BYTE_ORDER 0x01020304
+#define EXPORT_BLOCKSIZE 1024
+
+/* Document vector file layout. The fixed header is followed by these
+   sections at the offsets it records, every one 8 byte aligned and in
+   the byte order of the writer (see byte_order):
+
+     ids           unsigned int[num_entries]     term column of each entry
+     freqs         unsigned int[num_entries]     term frequency of each entry
+     rows          unsigned long long[num_docs + 1]
+                                                 first entry of each document
+     max_freqs     unsigned int[num_docs]        maximum term frequency
+     norms         float[num_docs]               cosine normalization component
+     name_offsets  unsigned long long[num_docs + 1]
+                                                 offset of each name in names
+     names         char[]                        NUL terminated document names
+     term_offsets  unsigned long long[num_terms + 1]
+                                                 offset of each term in terms
+     terms         char[]                        NUL terminated terms by column
+
+   Together ids, freqs and rows are a compressed sparse row matrix with one
+   row per document, its entries sorted by column */
+typedef struct export_header EXPORT_HEADER;
+struct export_header {
+        char magic[8];
+        unsigned int byte_order;          /* EXPORT_BYTE_ORDER as written */
+        unsigned int options;             /* Term options the vectors were built with */
+        unsigned long long num_docs, num_terms, num_entries;
+        unsigned long long ids, freqs, rows, max_freqs, norms;
+        unsigned long long name_offsets, names, term_offsets, terms;
+        unsigned long long reserved[2];
+};
+
+void open_export(char *filename);
+void export_index(INDEX *idx, char *name);
+void close_export();
+
+#endif /* ! _HAVE_EXPORT_H */
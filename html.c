@@ -0,0 +1,219 @@
+/*
+
+  ----------------------------------------------------
+  vsm - vector space model data similarity
+  ----------------------------------------------------
+
+  Copyright (c) 2008 Jason Bittel <jason.bittel@gmail.com>
+
+*/
+
+/*
+  Streaming HTML text extraction. strip_html() removes markup from a line
+  in place, leaving only the text a browser would render: tags become word
+  separators, comments and the contents of script and style elements are
+  dropped, and common character entities are decoded. All parser state
+  lives in an HTML_STATE, so a document may be fed through in arbitrary
+  pieces with tags, comments and entities split across them. No memory is
+  allocated and the output is never longer than the input.
+*/
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "error.h"
+#include "html.h"
+
+#define MODE_TEXT 0
+#define MODE_TAG 1
+#define MODE_COMMENT 2
+#define MODE_RAW 3
+#define MODE_ENTITY 4
+
+/* Elements whose content is not text; indexed by HTML_STATE raw_tag */
+static char *raw_tags[] = { NULL, "script", "style" };
+
+/* Elements that may fall in the middle of a word, so are not separators */
+static char *inline_tags[] = {
+        "a", "abbr", "b", "big", "code", "em", "font", "i", "small",
+        "span", "strong", "sub", "sup", "tt", "u"
+};
+
+int raw_tag(char *name);
+int inline_tag(char *name);
+char decode_entity(char *ent);
+char *emit_entity(HTML_STATE *s, char *out, char *end);
+
+/* Reset state at the start of a new document */
+void init_html(HTML_STATE *s) {
+        memset(s, 0, sizeof(HTML_STATE));
+        s->mode = MODE_TEXT;
+
+        return;
+}
+
+/* Strip markup from line, continuing from the state left by the
+   previous line of the same document (modifies line) */
+char *strip_html(HTML_STATE *s, char *line) {
+        char *i, *j;
+        char c;
+
+#ifdef DEBUG
+        ASSERT(s && line);
+#endif
+
+        for (i = j = line; (c = *i) != '\0'; i++) {
+                switch (s->mode) {
+                case MODE_TEXT:
+                        if (c == '<') {
+                                s->mode = MODE_TAG;
+                                s->tag_len = 0;
+                                s->quote = '\0';
+                                s->tag[0] = '\0';
+                        } else if (c == '&') {
+                                s->mode = MODE_ENTITY;
+                                s->ent_len = 0;
+                        } else {
+                                *j++ = c;
+                        }
+                        break;
+
+                case MODE_TAG:
+                        if (s->quote) {
+                                if (c == s->quote) s->quote = '\0';
+                        } else if (s->tag_len == 0 && !isalpha(c) && c != '/' && c != '!' && c != '?') {
+                                /* A bare '<' in text, not a tag */
+                                if (j < i) *j++ = '<';
+                                s->mode = MODE_TEXT;
+                                i--;
+                        } else if (c == '>') {
+                                if (s->tag_len >= 0) s->tag[s->tag_len] = '\0';
+                                s->mode = MODE_TEXT;
+                                if ((s->raw_tag = raw_tag(s->tag))) {
+                                        s->mode = MODE_RAW;
+                                        s->raw_len = 0;
+                                }
+                                if (!inline_tag(s->tag)) *j++ = ' ';
+                        } else if (s->tag_len < MAX_TAG_LEN && s->tag_len >= 0) {
+                                /* Collect the name; -1 marks it complete */
+                                if (isspace(c) || (c == '/' && s->tag_len > 0)) {
+                                        s->tag[s->tag_len] = '\0';
+                                        s->tag_len = -1;
+                                } else {
+                                        s->tag[s->tag_len++] = tolower(c);
+                                        if (s->tag_len == 3 && !strncmp(s->tag, "!--", 3)) {
+                                                s->mode = MODE_COMMENT;
+                                                s->dashes = 0;
+                                        }
+                                }
+                        } else if (c == '"' || c == '\'') {
+                                s->quote = c;
+                        }
+                        break;
+
+                case MODE_COMMENT:
+                        if (c == '>' && s->dashes >= 2) {
+                                s->mode = MODE_TEXT;
+                                *j++ = ' ';
+                        }
+                        s->dashes = (c == '-') ? s->dashes + 1 : 0;
+                        break;
+
+                case MODE_RAW:
+                        /* Look for "</" followed by the element name */
+                        if (s->raw_len < 2) {
+                                if (c == "</"[s->raw_len]) s->raw_len++;
+                                else s->raw_len = (c == '<') ? 1 : 0;
+                        } else if (tolower(c) == raw_tags[s->raw_tag][s->raw_len - 2]) {
+                                if (raw_tags[s->raw_tag][++s->raw_len - 2] == '\0') {
+                                        /* Skip the rest of the closing tag */
+                                        s->mode = MODE_TAG;
+                                        s->tag[0] = '\0';
+                                        s->tag_len = -1;
+                                        s->quote = '\0';
+                                        s->raw_tag = 0;
+                                }
+                        } else {
+                                s->raw_len = (c == '<') ? 1 : 0;
+                        }
+                        break;
+
+                case MODE_ENTITY:
+                        if (c == ';') {
+                                s->ent[s->ent_len] = '\0';
+                                *j++ = decode_entity(s->ent);
+                                s->mode = MODE_TEXT;
+                        } else if ((isalnum(c) || c == '#') && s->ent_len < MAX_ENTITY_LEN) {
+                                s->ent[s->ent_len++] = c;
+                        } else {
+                                /* Not an entity after all; keep what was
+                                   collected as plain text */
+                                j = emit_entity(s, j, i);
+                                s->mode = MODE_TEXT;
+                                i--;
+                        }
+                        break;
+                }
+        }
+        *j = '\0';
+
+        return line;
+}
+
+/* Return the raw_tags index of an element with unparsed content, or 0 */
+int raw_tag(char *name) {
+        int i;
+
+        for (i = 1; i < (int) (sizeof(raw_tags) / sizeof(raw_tags[0])); i++) {
+                if (!strcmp(name, raw_tags[i])) return i;
+        }
+
+        return 0;
+}
+
+/* Return true if name, less any leading '/', is an inline element */
+int inline_tag(char *name) {
+        int i;
+
+        if (*name == '/') name++;
+        for (i = 0; i < (int) (sizeof(inline_tags) / sizeof(inline_tags[0])); i++) {
+                if (!strcmp(name, inline_tags[i])) return 1;
+        }
+
+        return 0;
+}
+
+/* Write back the characters of an abandoned entity, as many as fit
+   between out and end; only an entity split across lines can run short */
+char *emit_entity(HTML_STATE *s, char *out, char *end) {
+        int n;
+
+        if (out < end) *out++ = '&';
+        for (n = 0; n < s->ent_len && out < end; n++) {
+                *out++ = s->ent[n];
+        }
+
+        return out;
+}
+
+/* Translate a named or numeric character entity; anything outside of
+   ASCII decodes to a space */
+char decode_entity(char *ent) {
+        long code;
+
+        if (*ent == '#') {
+                if (ent[1] == 'x' || ent[1] == 'X') code = strtol(ent + 2, NULL, 16);
+                else code = strtol(ent + 1, NULL, 10);
+
+                return (code > 0 && code < 128) ? (char) code : ' ';
+        }
+
+        if (!strcmp(ent, "amp")) return '&';
+        if (!strcmp(ent, "lt")) return '<';
+        if (!strcmp(ent, "gt")) return '>';
+        if (!strcmp(ent, "quot")) return '"';
+        if (!strcmp(ent, "apos")) return '\'';
+
+        return ' ';
+}
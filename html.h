@@ -0,0 +1,35 @@
+/*
+
+  ----------------------------------------------------
+  vsm - vector space model data similarity
+  ----------------------------------------------------
+
+  Copyright (c) 2008 Jason Bittel <jason.bittel@gmail.com>
+ 
+*/
+
+#ifndef _HAVE_HTML_H
+#define _HAVE_HTML_H
+
+#define MAX_TAG_LEN 8
+#define MAX_ENTITY_LEN 10
+
+/* Parser state carried from one line to the next; a plain structure so
+   it can be kept on the stack or saved along with a checkpoint */
+typedef struct html_state HTML_STATE;
+struct html_state {
+        int mode;
+        int tag_len;
+        char tag[MAX_TAG_LEN + 1];        /* Lowercased start of the tag name */
+        char quote;                       /* Quote character of an open attribute */
+        int dashes;                       /* Consecutive dashes seen in a comment */
+        int raw_tag;                      /* Element whose raw content is being skipped */
+        int raw_len;                      /* Characters of its closing tag matched so far */
+        int ent_len;
+        char ent[MAX_ENTITY_LEN + 1];     /* Entity name collected so far */
+};
+
+void init_html(HTML_STATE *s);
+char *strip_html(HTML_STATE *s, char *line);
+
+#endif /* ! _HAVE_HTML_H */
@@ -9,287 +9,634 @@
 */
 
 /*
-  These functions define, build, and operate on the index. This index is currently
-  maintained as an unbalanced binary tree. We refer to it as an 'index' and not a
-  'tree' so that the underlying data structure could change without significant
-  refactoring.
+  These functions define, build, and operate on the index. Words are mapped
+  to integer ids by a term dictionary shared across the whole run, so a word
+  is stored only once no matter how many documents contain it; the index of
+  a document is then just a compact array of (term id, frequency) pairs,
+  with a small hash table locating the entry for an id. The query is
+  resolved to ids once, and scoring each document needs only integer
+  lookups. An index with a memory limit, or one built on another thread,
+  keeps a private dictionary instead so that spilling can release the term
+  strings too and concurrent indexes never share one.
+
+  Left alone, the shared dictionary would grow with the vocabulary of the
+  whole run. Between documents it is cut back to just the query terms
+  once it holds more than SHARED_DICT_LIMIT terms (see trim_shared_dict()),
+  so it holds at most that many plus the vocabulary of one document.
 */
 
-#define NODE_BLOCKSIZE 100
-#define ALLOC_BLOCKSIZE 10
+#define TERM_BLOCKSIZE 256
+#define MIN_SLOTS 64
+#define SHARED_DICT_LIMIT 262144
+
+/* Approximate bytes held per distinct term: its entries in the term arrays
+   and hash tables, plus the word itself when the dictionary is private */
+#define TERM_SIZE (4 * sizeof(int) + sizeof(unsigned int) + sizeof(char *))
 
 #include <math.h>
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include "dict.h"
 #include "error.h"
 #include "index.h"
+#include "spill.h"
+
+struct index {
+        DICT *dict;               /* Dictionary the term ids refer to */
+        int own_dict;             /* Set if dict is private to this index */
+        int *ids;                 /* Term ids, in order of first occurrence */
+        unsigned int *freqs;      /* Frequency of each term in ids */
+        int num_ids;
+        int size;                 /* Allocated length of ids and freqs */
+        int *slots;               /* Hash table of positions in ids; -1 if empty */
+        int num_slots;            /* Always a power of two */
+        size_t mem_used;          /* Bytes held by terms in memory */
+        size_t mem_limit;         /* Spill to disk past this; 0 for no limit */
+        RUN_SET *runs;            /* Sorted runs spilled to disk */
+        struct sig_state *sig;    /* Signature fed each tokenized line, or NULL */
+        INDEX_STATS stats;
+};
 
-typedef struct index_node INDEX_NODE;
-struct index_node {
+/* A term copied out of the index for sorting */
+typedef struct sort_term SORT_TERM;
+struct sort_term {
         char *word;
+        int len;
         unsigned int freq;
-        INDEX_NODE *left, *right;
 };
 
-static INDEX_NODE *terms = NULL;
-static INDEX_NODE *stack = NULL;
-static INDEX_NODE **alloc = NULL;
-INDEX_STATS stats;
+/* Run-wide dictionary used by default; its first num_query_terms ids are
+   the query terms */
+static DICT *shared_dict = NULL;
+static int num_query_terms = 0;
+
+void add_term(INDEX *idx, int id, unsigned int freq);
+int *find_position(INDEX *idx, int id);
+void grow_positions(INDEX *idx);
+void clear_terms(INDEX *idx);
+void spill_index(INDEX *idx);
+void merge_spilled(INDEX *idx, int *query, DOC_VIEW *view, int need_log);
+void merge_term(char *w, unsigned int freq, void *arg);
+int compare_terms(const void *a, const void *b);
+int compare_sort_terms(const void *a, const void *b);
+int get_frequency(INDEX *idx, int query_id);
+
+/* Allocate a new, empty index using the shared dictionary */
+INDEX *create_index() {
+        INDEX *idx;
+        int i;
+
+        if ((idx = (INDEX *) calloc(1, sizeof(INDEX))) == NULL) {
+                DIE("Cannot calloc memory for index");
+        }
+        if (!shared_dict) shared_dict = create_dict();
+        idx->dict = shared_dict;
+        idx->runs = create_run_set();
+
+        if ((idx->slots = (int *) malloc(MIN_SLOTS * sizeof(int))) == NULL) {
+                DIE("Cannot malloc memory for index table");
+        }
+        idx->num_slots = MIN_SLOTS;
+        for (i = 0; i < idx->num_slots; i++) idx->slots[i] = -1;
+
+        initialize_index(idx);
+
+        return idx;
+}
+
+/* Give an empty index a private dictionary; it may then be built on a
+   thread of its own */
+void isolate_index(INDEX *idx) {
+        if (idx->own_dict) return;
 
-float sum_norm_component(INDEX_NODE *node, int max_freq);
-int get_frequency(char *w);
-INDEX_NODE *get_node(INDEX_NODE **stack);
-INDEX_NODE *free_nodes(INDEX_NODE *node, INDEX_NODE *stack);
+#ifdef DEBUG
+        ASSERT(idx->num_ids == 0);
+#endif
+
+        idx->dict = create_dict();
+        idx->own_dict = 1;
+
+        return;
+}
 
 /* Initialize the index and associated statistics */
-void initialize_index() {
-        if (terms) free_index(); /* Make sure we start fresh */
- 
-        stats.max_height = 0;
-        stats.max_freq = 1;
-        stats.num_nodes = 0;
-        stats.num_insertions = 0;
+void initialize_index(INDEX *idx) {
+#ifdef DEBUG
+        ASSERT(idx);
+#endif
+
+        clear_terms(idx); /* Make sure we start fresh */
+        clear_runs(idx->runs);
+
+        idx->stats.max_freq = 1;
+        idx->stats.num_terms = 0;
+        idx->stats.num_insertions = 0;
+        idx->stats.num_runs = 0;
+
+        return;
+}
+
+/* Bound the memory used by the index to roughly limit bytes; past that
+   the terms are written to disk as a sorted run. A limit of 0 disables
+   spilling. A limited index is given its own dictionary, so that the
+   words it holds are released when it spills */
+void set_memory_limit(INDEX *idx, size_t limit) {
+        idx->mem_limit = limit;
+        if (limit) isolate_index(idx);
+
+        return;
+}
+
+/* Return the memory limit of the index, or 0 if it has none */
+size_t get_memory_limit(INDEX *idx) {
+        return idx->mem_limit;
+}
+
+/* Have every line tokenized into the index also added to the signature
+   sig, until it is set back to NULL */
+void sign_index(INDEX *idx, struct sig_state *sig) {
+        idx->sig = sig;
 
         return;
 }
 
-/* Insert a new node into the index in its proper position;
-   if node already exists, increment its frequency count */
-void insert_word(char *w) {
-        INDEX_NODE **node = &terms;
-        int cmp;
-        int curr_height = 0;
+/* Return the signature fed by the index, or NULL if there is none */
+struct sig_state *index_signature(INDEX *idx) {
+        return idx->sig;
+}
+
+/* Return a pointer to the statistics gathered while building the index */
+INDEX_STATS *index_stats(INDEX *idx) {
+        return &idx->stats;
+}
+
+/* Insert a new term into the index; if the term already exists,
+   increment its frequency count. The length of w is supplied by
+   the tokenizer */
+void insert_word(INDEX *idx, char *w, int len) {
+        insert_term(idx, w, len, 1);
+
+        return;
+}
 
+/* Add freq occurrences of w to the index */
+void insert_term(INDEX *idx, char *w, int len, unsigned int freq) {
 #ifdef DEBUG
         ASSERT(w);
 #endif
 
-        /* Search for node; if found increment its frequency and
-           update maximum frequency as necessary */
-        while (*node) {
-                curr_height++;
-                cmp = strcmp(w, (*node)->word);
-                if (cmp > 0) {
-                        node = &(*node)->right;
-                } else if (cmp < 0) {
-                        node = &(*node)->left;
-                } else {
-                        (*node)->freq++;
-                        stats.num_insertions++;
-                        if ((*node)->freq > stats.max_freq)
-                                stats.max_freq = (*node)->freq;
+        add_term(idx, intern_term(idx->dict, w, len), freq);
+        idx->stats.num_insertions += freq;
+
+        return;
+}
+
+/* Add freq occurrences of a term id to the index; if the term is new,
+   append it to the term arrays */
+void add_term(INDEX *idx, int id, unsigned int freq) {
+        int *pos;
 
-                        return;
+        pos = find_position(idx, id);
+        if (*pos >= 0) {
+                idx->freqs[*pos] += freq;
+                if (idx->freqs[*pos] > (unsigned int) idx->stats.max_freq)
+                        idx->stats.max_freq = idx->freqs[*pos];
+
+                return;
+        }
+
+        if (idx->num_ids == idx->size) {
+                idx->size += TERM_BLOCKSIZE;
+                idx->ids = (int *) realloc(idx->ids, idx->size * sizeof(int));
+                idx->freqs = (unsigned int *) realloc(idx->freqs, idx->size * sizeof(unsigned int));
+                if (!idx->ids || !idx->freqs) {
+                        DIE("Cannot realloc memory for index terms");
                 }
         }
 
-        /* Node not found, so insert a new one into the index */
-        *node = get_node(&stack);
- 
-        if (((*node)->word = (char *) malloc(strlen(w) + 1)) == NULL) {
-                DIE("Cannot allocate memory for node word");
+        *pos = idx->num_ids;
+        idx->ids[idx->num_ids] = id;
+        idx->freqs[idx->num_ids] = freq;
+        idx->num_ids++;
+        idx->stats.num_terms++;
+        if (freq > (unsigned int) idx->stats.max_freq)
+                idx->stats.max_freq = freq;
+
+        if (idx->num_ids * 2 > idx->num_slots) grow_positions(idx);
+
+        idx->mem_used += TERM_SIZE;
+        if (idx->own_dict) idx->mem_used += term_length(idx->dict, id) + 1;
+        if (idx->mem_limit && idx->mem_used > idx->mem_limit) spill_index(idx);
+
+        return;
+}
+
+/* Return the hash table slot holding the position of id, or the empty
+   slot where it belongs */
+int *find_position(INDEX *idx, int id) {
+        unsigned int mask = idx->num_slots - 1;
+        unsigned int i = ((unsigned int) id * 2654435761U) & mask;
+
+        while (idx->slots[i] >= 0 && idx->ids[idx->slots[i]] != id) {
+                i = (i + 1) & mask;
+        }
+
+        return &idx->slots[i];
+}
+
+/* Double the hash table and reinsert every position */
+void grow_positions(INDEX *idx) {
+        int i;
+
+        free(idx->slots);
+        idx->num_slots *= 2;
+        if ((idx->slots = (int *) malloc(idx->num_slots * sizeof(int))) == NULL) {
+                DIE("Cannot malloc memory for index table");
+        }
+        for (i = 0; i < idx->num_slots; i++) idx->slots[i] = -1;
+
+        for (i = 0; i < idx->num_ids; i++) {
+                *find_position(idx, idx->ids[i]) = i;
         }
 
-        strcpy((*node)->word, w);
-        (*node)->left = (*node)->right = NULL;
-        (*node)->freq = 1;
-        stats.num_nodes++;
-        stats.num_insertions++;
+        return;
+}
+
+/* Remove every term held in memory; statistics are left alone */
+void clear_terms(INDEX *idx) {
+        unsigned int mask = idx->num_slots - 1;
+        unsigned int j;
+        int i;
+
+        /* Every slot is being emptied, so clearing forward from each
+           term's home slot up to the end of its cluster is enough, and
+           avoids sweeping a large table for a small document */
+        for (i = 0; i < idx->num_ids; i++) {
+                j = ((unsigned int) idx->ids[i] * 2654435761U) & mask;
+                while (idx->slots[j] >= 0) {
+                        idx->slots[j] = -1;
+                        j = (j + 1) & mask;
+                }
+        }
+        idx->num_ids = 0;
+        idx->mem_used = 0;
 
-        /* Update maximum height encountered */
-        curr_height++;
-        if (curr_height > stats.max_height)
-                stats.max_height = curr_height;
+        if (idx->own_dict) clear_dict(idx->dict);
 
         return;
 }
 
-/* Iterate over the query vector and calculate the similarity against the index */
-float calculate_similarity(char **query) {
-        float term_freq, term_weight, norm_comp;
-        float similarity = 0;
-        char **i;
+/* Call fn for every term held in memory; terms are visited in order of
+   first occurrence, so inserting them into an empty index rebuilds an
+   identical one */
+void walk_index(INDEX *idx, void (*fn)(char *w, unsigned int freq, void *arg), void *arg) {
+        int i;
 
-#ifdef DEBUG
-        ASSERT(query);
-#endif
+        for (i = 0; i < idx->num_ids; i++) {
+                fn(term_string(idx->dict, idx->ids[i]), idx->freqs[i], arg);
+        }
 
-        /* Bail if index is empty */
-        if (!terms) return -1;
-
-        /* 
-         * Calculate the cosine normalization component across the index:
-         *    1 / sqrt(summation((tf / max tf)^2))
-         */
-        norm_comp = sqrt(sum_norm_component(terms, stats.max_freq));
-        PRINT("Cosine normalization component is %.2f", norm_comp);
-
-        /* 
-         * Iterate through each term in the query vector and calculate the
-         * corresponding document term weight:
-         *    (tf / max tf) / normalization component
-         *
-         * Since each query term has a weight of 1, the similarity is merely
-         * the sum of the document term weights. Since the same query term can
-         * appear multiple times, technically they are weighted by frequency.
-         */
-        for (i = query; *i; i++) {
-                term_freq = get_frequency(*i) / (float) stats.max_freq;
-                term_weight = term_freq / norm_comp;
-                PRINT("   '%s' occurs %.2f times with weight %.2f", *i, term_freq, term_weight);
-
-                similarity += term_weight;
+        return;
+}
+
+/* Call fn for every term of the document, including any spilled to disk.
+   Spilled terms are visited in strcmp() order; the runs are kept, so the
+   index can still be scored afterwards */
+void walk_terms(INDEX *idx, void (*fn)(char *w, unsigned int freq, void *arg), void *arg) {
+        if (idx->stats.num_runs == 0) {
+                walk_index(idx, fn, arg);
+
+                return;
         }
 
-        PRINT("Similarity: %.4f", similarity);
+        spill_index(idx);
+        merge_runs(idx->runs, fn, arg);
 
-        return similarity;
+        return;
 }
 
-/* Calculate the index summation portion of the cosine normalization component */
-float sum_norm_component(INDEX_NODE *node, int max_freq) {
-        float term_freq;
+/* Fold the terms and counts of src into dst, leaving src empty; used to
+   combine partial indexes built over separate pieces of one document */
+void merge_index(INDEX *dst, INDEX *src) {
+        char *w;
+        int i;
 
 #ifdef DEBUG
-        ASSERT(max_freq > 0);
+        ASSERT(dst && src);
 #endif
 
-        if (!node) return 0;
+        move_runs(dst->runs, src->runs);
+        dst->stats.num_runs += src->stats.num_runs;
 
-        term_freq = node->freq / (float) max_freq;
-        term_freq *= term_freq;
+        for (i = 0; i < src->num_ids; i++) {
+                if (src->dict == dst->dict) {
+                        add_term(dst, src->ids[i], src->freqs[i]);
+                } else {
+                        w = term_string(src->dict, src->ids[i]);
+                        add_term(dst, intern_term(dst->dict, w, term_length(src->dict, src->ids[i])), src->freqs[i]);
+                }
+        }
+        dst->stats.num_insertions += src->stats.num_insertions;
+        initialize_index(src);
+
+        return;
+}
+
+/* Intern each query term into the shared dictionary and return their
+   ids, terminated by -1 */
+int *resolve_terms(char **terms) {
+        int *ids;
+        int i, n;
+
+        if (!shared_dict) shared_dict = create_dict();
+
+        for (n = 0; terms[n]; n++);
+        if ((ids = (int *) malloc((n + 1) * sizeof(int))) == NULL) {
+                DIE("Cannot malloc memory for query term ids");
+        }
 
-        term_freq += sum_norm_component(node->left, max_freq);
-        term_freq += sum_norm_component(node->right, max_freq);
+        for (i = 0; i < n; i++) {
+                ids[i] = intern_term(shared_dict, terms[i], strlen(terms[i]));
+        }
+        ids[n] = -1;
+        num_query_terms = count_terms(shared_dict);
 
-        return term_freq;
+        return ids;
 }
 
-/* Return the frequency of the parameter word; return 0 if not found */
-int get_frequency(char *w) {
-        INDEX_NODE *node = terms;
-        int cmp;
-
-        while (node) {
-                cmp = strcmp(w, node->word);
-                if (cmp > 0) {
-                        node = node->right;
-                } else if (cmp < 0) {
-                        node = node->left;
-                } else {
-                        return node->freq;
+/* Intern a single query term, whose dictionary hash is already known,
+   into the shared dictionary and return its id */
+int resolve_term(char *w, int len, unsigned int hash) {
+        int id;
+
+        if (!shared_dict) shared_dict = create_dict();
+
+        id = intern_hashed(shared_dict, w, len, hash);
+        num_query_terms = count_terms(shared_dict);
+
+        return id;
+}
+
+/* Once the shared dictionary holds more than SHARED_DICT_LIMIT terms, drop
+   all but the query terms, which keep their ids. Only call this between
+   documents: an index using the shared dictionary must be initialized
+   before it is used again */
+void trim_shared_dict() {
+        char **words;
+        int *lens;
+        int i;
+
+        if (!shared_dict || count_terms(shared_dict) <= SHARED_DICT_LIMIT) return;
+
+        words = (char **) malloc((num_query_terms + 1) * sizeof(char *));
+        lens = (int *) malloc((num_query_terms + 1) * sizeof(int));
+        if (!words || !lens) {
+                DIE("Cannot malloc memory for query terms");
+        }
+        for (i = 0; i < num_query_terms; i++) {
+                lens[i] = term_length(shared_dict, i);
+                if ((words[i] = (char *) malloc(lens[i] + 1)) == NULL) {
+                        DIE("Cannot malloc memory for query term");
                 }
+                memcpy(words[i], term_string(shared_dict, i), lens[i] + 1);
         }
 
-        return 0;
+        clear_dict(shared_dict);
+
+        /* Interned again in id order, each gets back the id it had */
+        for (i = 0; i < num_query_terms; i++) {
+                intern_term(shared_dict, words[i], lens[i]);
+                free(words[i]);
+        }
+        free(words);
+        free(lens);
+
+        return;
 }
 
-/*** MEMORY MANAGEMENT/ALLOCATION FUNCTIONS ***/
+/* Fill in a flat view of the index for scoring: the frequency of each
+   query term, in query order, along with whole document statistics. The
+   caller supplies view->query_freqs large enough for the query. Returns
+   0 if the index is empty. When need_log is set the summations of log
+   frequency weights are gathered too */
+int view_index(INDEX *idx, int *query, DOC_VIEW *view, int need_log) {
+        double sum_squares = 0, sum_logs = 0, sum_log_squares = 0, w;
+        int i;
 
-/* Get a new node from either the free stack or the allocated block;
-   if the block is empty, allocate a new chunk of memory */
-INDEX_NODE *get_node(INDEX_NODE **stack) {
-        static INDEX_NODE *block = NULL, *tail, **mv;
-        static int alloc_size = 0;
-        INDEX_NODE *head, **tmp;
- 
-        if (*stack != NULL) {
-                head = *stack;
-                *stack = (*stack)->left;
-                head->left = NULL;
-        } else if (block != NULL) {
-                head = block;
-                if (block == tail)
-                        block = NULL;
-                else
-                        block++;
-        } else {
-                if ((block = (INDEX_NODE *) calloc(NODE_BLOCKSIZE, sizeof(INDEX_NODE))) == NULL) {
-                        DIE("Cannot calloc memory for node block");
-                }
+#ifdef DEBUG
+        ASSERT(query && view->query_freqs);
+#endif
 
-                /* Store pointer to allocated block so we can free it later */
-                if (alloc == NULL) {
-                        if ((alloc = (INDEX_NODE **) malloc(ALLOC_BLOCKSIZE * sizeof(INDEX_NODE *))) == NULL) {
-                                DIE("Cannot malloc memory for blocks array");
-                        }
+        /* Bail if index is empty */
+        if (idx->num_ids == 0 && count_runs(idx->runs) == 0) return 0;
 
-                        mv = alloc;
+        /* A spilled index is first merged back together, which leaves only
+           the query terms in memory */
+        if (count_runs(idx->runs) > 0) {
+                merge_spilled(idx, query, view, need_log);
+        } else {
+                /* Summed exactly as tf^2 and scaled later, like merge_spilled() */
+                for (i = 0; i < idx->num_ids; i++) {
+                        sum_squares += (double) idx->freqs[i] * idx->freqs[i];
                 }
-
-                *mv = block;
- 
-                if (++alloc_size % ALLOC_BLOCKSIZE == 0) {
-                        tmp = realloc(alloc, ((alloc_size + ALLOC_BLOCKSIZE) * sizeof(INDEX_NODE *)));
-                        if (!tmp) {
-                                DIE("Cannot realloc memory for blocks array");
+                if (need_log) {
+                        for (i = 0; i < idx->num_ids; i++) {
+                                w = 1 + log(idx->freqs[i]);
+                                sum_logs += w;
+                                sum_log_squares += w * w;
                         }
-                        alloc = tmp;
-                        mv = alloc + alloc_size - 1;
-                }
- 
-                mv++;
-                *mv = NULL;
-
-                /* Update pointers with new block information */
-                tail = block + NODE_BLOCKSIZE - 1;
-                head = block;
-                if (block == tail) {
-                        block = NULL;
-                } else {
-                        block++;
                 }
+                view->sum_squares = sum_squares;
+                view->sum_logs = sum_logs;
+                view->sum_log_squares = sum_log_squares;
+        }
+
+        view->max_freq = idx->stats.max_freq;
+        view->num_terms = idx->stats.num_terms;
+        view->length = idx->stats.num_insertions;
+
+        for (i = 0; query[i] >= 0; i++) {
+                view->query_freqs[i] = get_frequency(idx, query[i]);
         }
+        view->query_size = i;
 
-        return head;
+        return 1;
 }
 
-/* Release all memory allocated by get_node() back to the OS; only
-   called at program termination */
-void destroy_index() {
-        INDEX_NODE **i;
+/* Return the string for a query term id */
+char *query_term(int id) {
+        return term_string(shared_dict, id);
+}
+
+/* Return the frequency of a query term id; return 0 if not found. An
+   index with its own dictionary must first translate the id */
+int get_frequency(INDEX *idx, int query_id) {
+        int id = query_id;
+        int pos;
+
+        if (idx->own_dict) {
+                id = lookup_term(idx->dict, term_string(shared_dict, query_id), term_length(shared_dict, query_id));
+                if (id < 0) return 0;
+        }
+
+        pos = *find_position(idx, id);
+
+        return (pos >= 0) ? idx->freqs[pos] : 0;
+}
+
+/*** EXTERNAL MEMORY FUNCTIONS ***/
+
+typedef struct merge_state MERGE_STATE;
+struct merge_state {
+        INDEX *idx;
+        char **sorted_query;      /* Query terms in strcmp() order */
+        int query_size;
+        double sum_squares;       /* Summation of tf^2 across all terms */
+        double sum_logs;          /* Summation of 1 + ln tf, if need_log */
+        double sum_log_squares;   /* Summation of (1 + ln tf)^2, if need_log */
+        int need_log;
+};
 
-        if (!alloc) return;
-        if (terms) free_index();
+/* Write the in-memory terms to disk as a sorted run and empty the index */
+void spill_index(INDEX *idx) {
+        SORT_TERM *terms;
+        FILE *fp;
+        int i;
 
-        for (i = alloc; *i; i++) {
-                free(*i);
+        if (idx->num_ids == 0) return;
+
+        if ((terms = (SORT_TERM *) malloc(idx->num_ids * sizeof(SORT_TERM))) == NULL) {
+                DIE("Cannot malloc memory for index run");
+        }
+        for (i = 0; i < idx->num_ids; i++) {
+                terms[i].word = term_string(idx->dict, idx->ids[i]);
+                terms[i].len = term_length(idx->dict, idx->ids[i]);
+                terms[i].freq = idx->freqs[i];
+        }
+        qsort(terms, idx->num_ids, sizeof(SORT_TERM), compare_sort_terms);
+
+        fp = new_run(idx->runs);
+        for (i = 0; i < idx->num_ids; i++) {
+                write_run_term(fp, terms[i].word, terms[i].len, terms[i].freq);
+        }
+        if (fflush(fp) != 0) {
+                DIE("Cannot write index run to disk");
         }
+        free(terms);
 
-        free(alloc);
+        clear_terms(idx);
+        idx->stats.num_runs++;
 
         return;
 }
 
-/* Return all nodes to internal stack; this wrapper function is
-   necessary as neither index or stack is visible outside this file */
-void free_index() {
+/* Merge all runs of a spilled index to find the exact maximum frequency,
+   term count and summations for view; only the query terms are loaded
+   back into the index */
+void merge_spilled(INDEX *idx, int *query, DOC_VIEW *view, int need_log) {
+        MERGE_STATE state;
+        size_t mem_limit;
+        int i;
+
+        spill_index(idx);
+
+        /* The query terms reloaded below must not be spilled again */
+        mem_limit = idx->mem_limit;
+        idx->mem_limit = 0;
+
+        state.idx = idx;
+        state.sum_squares = 0;
+        state.sum_logs = 0;
+        state.sum_log_squares = 0;
+        state.need_log = need_log;
+        for (state.query_size = 0; query[state.query_size] >= 0; state.query_size++);
+
+        if ((state.sorted_query = (char **) malloc(state.query_size * sizeof(char *))) == NULL) {
+                DIE("Cannot malloc memory for sorted query");
+        }
+        for (i = 0; i < state.query_size; i++) {
+                state.sorted_query[i] = term_string(shared_dict, query[i]);
+        }
+        qsort(state.sorted_query, state.query_size, sizeof(char *), compare_terms);
 
-#ifdef DEBUG
-        ASSERT(terms);
-#endif
+        idx->stats.max_freq = 1;
+        idx->stats.num_terms = 0;
+        merge_runs(idx->runs, merge_term, &state);
+        PRINT("Merged %d index runs holding %d unique terms", count_runs(idx->runs), idx->stats.num_terms);
+        PRINT("Maximum term frequency encountered was %d", idx->stats.max_freq);
 
-        stack = free_nodes(terms, stack);
-        terms = NULL;
+        free(state.sorted_query);
+        clear_runs(idx->runs);
+        idx->mem_limit = mem_limit;
+
+        view->sum_squares = state.sum_squares;
+        view->sum_logs = state.sum_logs;
+        view->sum_log_squares = state.sum_log_squares;
 
         return;
 }
 
-/* Recursively traverse the index returning nodes to the free stack */
-INDEX_NODE *free_nodes(INDEX_NODE *node, INDEX_NODE *stack) {
-        if (!node) return NULL;
+/* Callback for merge_runs(); accumulate statistics for one distinct term */
+void merge_term(char *w, unsigned int freq, void *arg) {
+        MERGE_STATE *state = (MERGE_STATE *) arg;
+        INDEX *idx = state->idx;
+        INDEX_STATS saved;
+        double weight;
+
+        idx->stats.num_terms++;
+        if (freq > (unsigned int) idx->stats.max_freq)
+                idx->stats.max_freq = freq;
+        state->sum_squares += (double) freq * freq;
+        if (state->need_log) {
+                weight = 1 + log(freq);
+                state->sum_logs += weight;
+                state->sum_log_squares += weight * weight;
+        }
 
-        free_nodes(node->left, stack);
-        free_nodes(node->right, stack);
+        /* Keep query terms in memory for get_frequency(), without
+           letting them count twice in the statistics */
+        if (bsearch(&w, state->sorted_query, state->query_size, sizeof(char *), compare_terms)) {
+                saved = idx->stats;
+                insert_term(idx, w, strlen(w), freq);
+                idx->stats = saved;
+        }
 
-        free(node->word);
-        memset(node, 0, sizeof(INDEX_NODE));
+        return;
+}
 
-        /* Reuse the left pointer as a "next" pointer
-           so that we don't waste space in each node */
-        node->left = stack;
-        stack = node;
+/* qsort()/bsearch() comparison function for arrays of strings */
+int compare_terms(const void *a, const void *b) {
+        return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+/* qsort() comparison function for terms being spilled */
+int compare_sort_terms(const void *a, const void *b) {
+        return strcmp(((const SORT_TERM *) a)->word, ((const SORT_TERM *) b)->word);
+}
 
-        return stack;
+/*** MEMORY MANAGEMENT/ALLOCATION FUNCTIONS ***/
+
+/* Release all memory held by the index back to the OS, including
+   the index itself */
+void destroy_index(INDEX *idx) {
+        if (!idx) return;
+
+        destroy_run_set(idx->runs);
+        if (idx->own_dict) destroy_dict(idx->dict);
+        free(idx->ids);
+        free(idx->freqs);
+        free(idx->slots);
+        free(idx);
+
+        return;
+}
+
+/* Release the shared dictionary; every index using it must already
+   have been destroyed */
+void destroy_shared_dict() {
+        destroy_dict(shared_dict);
+        shared_dict = NULL;
+
+        return;
 }
@@ -11,20 +11,55 @@
 #ifndef _HAVE_INDEX_H
 #define _HAVE_INDEX_H
 
+#include <stddef.h>
+
 typedef struct index_stats INDEX_STATS;
 struct index_stats {
-        int max_height;
         int max_freq;
-        int num_nodes;
+        int num_terms;            /* Distinct terms */
         int num_insertions;
+        int num_runs;             /* Times the index was spilled to disk */
+};
+
+/* Flat view of a document for the scoring models */
+typedef struct doc_view DOC_VIEW;
+struct doc_view {
+        float *query_freqs;       /* Frequency of each query term, in query order */
+        int query_size;
+        double max_freq;
+        int num_terms;            /* Distinct terms */
+        double length;            /* Occurrences of all terms */
+        double sum_squares;       /* Summation of tf^2 over all terms */
+        double sum_logs;          /* Summation of 1 + ln tf over all terms */
+        double sum_log_squares;   /* Summation of (1 + ln tf)^2 over all terms */
 };
 
-extern INDEX_STATS stats;
+/* Signature of a document in progress (see dedup.h) */
+struct sig_state;
+
+/* Opaque handle; each index owns its own nodes and statistics so that
+   several of them can be built concurrently */
+typedef struct index INDEX;
 
-void initialize_index();
-void insert_word(char *w);
-float calculate_similarity(char **query);
-void destroy_index();
-void free_index();
+INDEX *create_index();
+void isolate_index(INDEX *idx);
+void initialize_index(INDEX *idx);
+void set_memory_limit(INDEX *idx, size_t limit);
+size_t get_memory_limit(INDEX *idx);
+void sign_index(INDEX *idx, struct sig_state *sig);
+struct sig_state *index_signature(INDEX *idx);
+void insert_word(INDEX *idx, char *w, int len);
+void insert_term(INDEX *idx, char *w, int len, unsigned int freq);
+void walk_index(INDEX *idx, void (*fn)(char *w, unsigned int freq, void *arg), void *arg);
+void walk_terms(INDEX *idx, void (*fn)(char *w, unsigned int freq, void *arg), void *arg);
+void merge_index(INDEX *dst, INDEX *src);
+INDEX_STATS *index_stats(INDEX *idx);
+int *resolve_terms(char **terms);
+int resolve_term(char *w, int len, unsigned int hash);
+void trim_shared_dict();
+int view_index(INDEX *idx, int *query, DOC_VIEW *view, int need_log);
+char *query_term(int id);
+void destroy_index(INDEX *idx);
+void destroy_shared_dict();
 
 #endif /* ! _HAVE_INDEX_H */
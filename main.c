@@ -8,46 +8,85 @@
 
 */
 
+#define _XOPEN_SOURCE 600
+
 #define PROG_NAME "vsm"
 #define PROG_VER "0.0.1"
-#define MAX_LINE_LEN 2048
 #define QUERY_BLOCKSIZE 50
 
-#include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include "capture.h"
+#include "checkpoint.h"
+#include "chunk.h"
+#include "decompress.h"
+#include "dedup.h"
 #include "error.h"
+#include "export.h"
+#include "html.h"
 #include "index.h"
-#include "stem.h"
+#include "prefetch.h"
+#include "profile.h"
+#include "rank.h"
+#include "sample.h"
+#include "score.h"
+#include "tokenize.h"
 
-int getopt(int, char * const *, const char *);
 void build_query(char *filename);
 void destroy_query();
-void build_index(char *filename);
-char *standardize_line(char *str);
-int stop_word(char *word);
+void score_file(char *filename);
+void measure_files(char **files, int count);
+void build_index(char *filename, char *buf, size_t len, SIG_STATE *sig);
+char *read_line(FILE *fp, char *line, char **head, size_t *len);
 void handle_signal(int sig);
 void cleanup();
 void display_usage();
 
-/* Query vector data structure */
+/* Query vector data structure, the dictionary ids of its terms, and the
+   fingerprint of the whole query */
 static char **query = NULL;
+static int *query_ids = NULL;
+static SIGNATURE query_hash = 0;
+
+/* Document index, reused for each data file */
+static INDEX *doc_index = NULL;
 
 /* Command line arguments */
-static int min_len = 0;
-static int do_stemming = 1;
-static int do_stop_words = 1;
+static int num_threads = 1;
+static int read_ahead = 4;
+static int mem_limit = 0;
+static int do_dedup = 0;
+static int do_capture = 0;
+static double sample_rate = 0;
+static char *rank_dir = NULL;
+static int top_k = RANK_DEFAULT_K;
+static float min_score = 0;
+static int use_min_score = 0;
+static char *sigfile = NULL;
+static char *checkpoint_dir = NULL;
+static char *export_file = NULL;
 static char *termfile = NULL;
+static char *models = NULL;
+static int do_compile = 0;
+static int first_pass = 0;        /* Only measuring document lengths */
 int quiet_mode = 0;               /* Defined as extern in error.h */
 
-/* Read query terms from input file and insert them into a dynamic array */
+/* Read query terms from input file and insert them into a dynamic array;
+   a compiled query profile is loaded as is */
 void build_query(char *filename) {
         FILE *fp;
         char buf[MAX_LINE_LEN];
-        char *line, *p, *term;
+        char *line, *term;
         char **mv, **tmp;
-        int size = 0;
+        int len, size = 0;
+
+        if (is_profile(filename)) {
+                query_ids = load_profile(filename, &query_hash);
+
+                return;
+        }
 
         if ((fp = fopen(filename, "r")) == NULL) {
                 DIE("Cannot open file '%s'", filename);
@@ -64,17 +103,15 @@ void build_query(char *filename) {
  
                 line = standardize_line(line);
 
-                for (p = line; (term = strtok(p, " ")); p = NULL) {
-                        if (min_len && (strlen(term) < min_len)) continue;
-                        if (do_stop_words && stop_word(term)) continue;
-                        if (do_stemming) stem(term);
+                while ((term = next_word(&line, &len))) {
+                        if ((len = filter_term(term, len)) == 0) continue;
 
-                        if ((*mv = (char *) malloc(strlen(term) + 1)) == NULL) {
+                        if ((*mv = (char *) malloc(len + 1)) == NULL) {
                                 *mv = NULL;
                                 destroy_query();
                                 DIE("Cannot malloc memory for query term");
                         }
-                        strcpy(*mv, term);
+                        memcpy(*mv, term, len + 1);
 
                         if (++size % QUERY_BLOCKSIZE == 0) {
                                 tmp = realloc(query, ((size + QUERY_BLOCKSIZE) * sizeof(char *)));
@@ -96,6 +133,9 @@ void build_query(char *filename) {
 
         if (size == 0) DIE("No query terms found in '%s'", filename);
 
+        query_ids = resolve_terms(query);
+        query_hash = hash_terms(query);
+
         PRINT("Query vector constructed with dimensionality of %d", size);
 
         return;
@@ -105,6 +145,9 @@ void build_query(char *filename) {
 void destroy_query() {
         char **i;
 
+        free(query_ids);
+        query_ids = NULL;
+
         if (!query) return;
 
         for (i = query; *i; i++) {
@@ -112,132 +155,191 @@ void destroy_query() {
         }
 
         free(query);
+        query = NULL;
 
         return;
 }
 
-/* Read data from file and insert into an index structure; if filename
-   is NULL, read from STDIN */
-void build_index(char *filename) {
-        FILE *fp;
-        char buf[MAX_LINE_LEN];
-        char *line, *p, *word;
-
-        if (filename) {
-                if ((fp = fopen(filename, "r")) == NULL) {
-                        DIE("\nCannot open file '%s'", filename);
-                }
-                PRINT("\nReading data file '%s'", filename);
-        } else {
-                fp = stdin;
-                PRINT("\nReading data from STDIN");
+/* Index and score a single data file, printing its similarity; if
+   filename is NULL, read from STDIN. Large files are only sampled when a
+   sample rate is set. When duplicate detection is enabled, the file is
+   signed as it is indexed, and one that nearly matches an earlier
+   document reuses its score. Only documents that are indexed in full and
+   scored are exported */
+void score_file(char *filename) {
+        char *buf = NULL;
+        size_t len = 0;
+        SIG_STATE state;
+        SIGNATURE sig = 0;
+        DUPLICATE *dup;
+        float scores[MAX_MODELS];
+        int have_sig = 0;
+
+        /* The words of earlier documents are no longer needed */
+        trim_shared_dict();
+
+        /* Every file takes its read-ahead slot in turn, whichever way it
+           is read, so later files aren't handed the wrong contents */
+        if (filename) buf = next_prefetched(filename, &len);
+
+        /* Signatures cover the whole file, so sampled files are never
+           checked for duplicates */
+        if (filename && sample_rate > 0 &&
+            score_sampled(filename, query_ids, sample_rate, (size_t) mem_limit * 1024 * 1024)) {
+                if (buf) release_prefetched();
+
+                return;
         }
 
-        initialize_index();
+        build_index(filename, buf, len, (do_dedup && filename && !first_pass) ? &state : NULL);
+        if (buf) release_prefetched();
 
-        while ((line = fgets(buf, sizeof(buf) - 1, fp))) {
-                line = standardize_line(line);
+        /* Compressed files are signed by their decompressed text; files
+           too short to sign are always scored */
+        if (do_dedup && filename && !first_pass && (have_sig = fold_signature(&state, &sig)) &&
+            (dup = find_duplicate(sig))) {
+                PRINT("Data file is a near-duplicate of '%s'", dup->name);
+                print_similarity(dup->scores, "near-duplicate of %s", dup->name);
 
-                /* TODO: Instead of merely stripping unwanted characters and
-                 * tokenizing on spaces, we ought to implement a word delimeters
-                 * table and split words using those. Really, it will probably be
-                 * an inverted table: everything *not* specified is considered a
-                 * word boundary */
-                for (p = line; (word = strtok(p, " ")); p = NULL) {
-                        if (min_len && (strlen(word) < min_len)) continue;
-                        if (do_stop_words && stop_word(word)) continue;
-                        if (do_stemming) stem(word);
-
-                        insert_word(word);
-                }
+                return;
         }
 
-        fclose(fp);
+        if (export_file && !first_pass) export_index(doc_index, (filename) ? filename : "-");
 
-        if (stats.num_nodes == 0) {
-                WARN("No data found in '%s'", filename);
-        } else {
-                PRINT("Data file contained %d valid terms", stats.num_insertions);
-                PRINT("Index constructed with %d nodes and height %d", stats.num_nodes, stats.max_height);
-                PRINT("Maximum term frequency encountered was %d", stats.max_freq);
+        score_index(doc_index, query_ids, scores);
+        print_similarity(scores, NULL);
+
+        if (have_sig) add_signature(sig, scores, filename);
+
+        return;
+}
+
+/* Run through the data files once without printing any scores, only to
+   find the average document length that BM25 compares each one with */
+void measure_files(char **files, int count) {
+        int quiet = quiet_mode;
+        int i;
+
+        quiet_mode = 1;
+        first_pass = 1;
+        measure_lengths(1);
+
+        start_prefetch(files, count, read_ahead);
+        for (i = 0; i < count; i++) {
+                score_file(files[i]);
         }
+        stop_prefetch();
+
+        measure_lengths(0);
+        first_pass = 0;
+        quiet_mode = quiet;
 
         return;
 }
 
-/* Normalize string into a sequence of single space delimited alphanumeric words (modifies str);
-   initial concept borrowed (and heavily adapted) from xref.c by Bert Bos */
-char *standardize_line(char *str) {
-        char *i, *j;
+/* Read data from file and insert into an index structure; if buf is
+   given it holds the file contents already read ahead, and if filename
+   is NULL, read from STDIN. If sig is given, the document is signed
+   into it as it is read */
+void build_index(char *filename, char *buf, size_t len, SIG_STATE *sig) {
+        FILE *fp;
+        HTML_STATE html;
+        char line_buf[MAX_LINE_LEN];
+        char head[4];
+        char *line, *p = head;
+        size_t head_len = 0;
+        INDEX_STATS *stats;
+        int num_chunks, format;
+
+        if (!doc_index) {
+                doc_index = create_index();
+                set_memory_limit(doc_index, (size_t) mem_limit * 1024 * 1024);
+        }
+        initialize_index(doc_index);
+        if (sig) init_signature(sig);
+        sign_index(doc_index, sig);
+
+        if (filename && (format = detect_compression(filename, buf, len))) {
+                /* Compressed; inflate on a second thread while tokenizing */
+                PRINT("\nReading data file '%s'", filename);
+                build_index_compressed(doc_index, filename, buf, len, format);
+        } else if (filename && checkpoint_dir) {
+                /* Resume from the last checkpoint and read only new data */
+                PRINT("\nReading data file '%s'", filename);
+                build_index_incremental(doc_index, checkpoint_dir, filename);
+        } else if (filename && (num_chunks = count_chunks(filename, num_threads)) > 1) {
+                /* Large regular file; split it across threads */
+                PRINT("\nReading data file '%s'", filename);
+                build_index_chunked(doc_index, filename, num_chunks);
+        } else if (buf) {
+                /* Contents already loaded by a reader thread */
+                PRINT("\nReading data file '%s'", filename);
+                tokenize_buffer(doc_index, buf, len);
+        } else {
+                if (filename) {
+                        if ((fp = fopen(filename, "r")) == NULL) {
+                                DIE("\nCannot open file '%s'", filename);
+                        }
+                        PRINT("\nReading data file '%s'", filename);
+                } else {
+                        fp = stdin;
+                        PRINT("\nReading data from STDIN");
+                        head_len = fread(head, 1, sizeof(head), fp);
+                }
+
+                if (!filename && (format = detect_compression(NULL, head, head_len))) {
+                        /* Compressed; recognized by the bytes read off STDIN */
+                        build_index_compressed(doc_index, NULL, head, head_len, format);
+                } else {
+                        init_html(&html);
+                        while ((line = read_line(fp, line_buf, &p, &head_len))) {
+                                if (do_html) strip_html(&html, line);
+                                tokenize_line(doc_index, line);
+                        }
+                }
 
-#ifdef DEBUG
-        ASSERT(str);
-#endif
+                fclose(fp);
+        }
+
+        sign_index(doc_index, NULL);
 
-        for (j = str, i = str; *j != '\0'; j++) {
-                if (isupper(*j)) *i++ = tolower(*j);            /* Convert to lowercase */
-                else if (isalnum(*j) || *j == '-') *i++ = *j;   /* Keep only alphanumerics and dashes */
-                else if (isspace(*j) && i != str &&            
-                            *(i - 1) != ' ') *i++ = ' ';        /* Separate all words with a single space */
+        stats = index_stats(doc_index);
+        if (stats->num_insertions == 0) {
+                if (!first_pass) WARN("No data found in '%s'", filename);
+        } else if (stats->num_runs > 0) {
+                /* The runs are counted once they are merged for scoring */
+                PRINT("Data file contained %d valid terms", stats->num_insertions);
+                PRINT("Index exceeded its memory limit and was spilled to disk");
+        } else {
+                PRINT("Data file contained %d valid terms", stats->num_insertions);
+                PRINT("Index constructed with %d distinct terms", stats->num_terms);
+                PRINT("Maximum term frequency encountered was %d", stats->max_freq);
         }
-        *i = '\0';
 
-        return str;
+        return;
 }
 
-/* Remove common correlative words that typically convey no meaning */
-int stop_word(char *word) {
-
-#ifdef DEBUG
-        ASSERT(word);
-#endif
-
-        switch (*word) {
-                case 'a':
-                        if (!strcmp(word, "a")) return 1;
-                        if (!strcmp(word, "after")) return 1;
-                        if (!strcmp(word, "also")) return 1;
-                        if (!strcmp(word, "although")) return 1;
-                        if (!strcmp(word, "an")) return 1;
-                        if (!strcmp(word, "and")) return 1;
-                        break;
-                case 'b':
-                        if (!strcmp(word, "because")) return 1;
-                        if (!strcmp(word, "both")) return 1;
-                        if (!strcmp(word, "but")) return 1;
-                        break;
-                case 'e':
-                        if (!strcmp(word, "either")) return 1;
-                        break;
-                case 'f':
-                        if (!strcmp(word, "for")) return 1;
-                        break;
-                case 'i':
-                        if (!strcmp(word, "if")) return 1;
-                        break;
-                case 'n':
-                        if (!strcmp(word, "nor")) return 1;
-                        if (!strcmp(word, "not")) return 1;
-                        break;
-                case 'o':
-                        if (!strcmp(word, "or")) return 1;
-                        break;
-                case 's':
-                        if (!strcmp(word, "so")) return 1;
-                        break;
-                case 't':
-                        if (!strcmp(word, "the")) return 1;
-                        break;
-                case 'u':
-                        if (!strcmp(word, "unless")) return 1;
-                        break;
-                case 'y':
-                        if (!strcmp(word, "yet")) return 1;
-                        break;
-                default: return 0;
+/* Read the next line from fp, cut exactly as fgets() would cut it with a
+   MAX_LINE_LEN buffer, after first taking the len bytes at *head that
+   were already read from fp; returns NULL at the end of the input */
+char *read_line(FILE *fp, char *line, char **head, size_t *len) {
+        size_t n = 0;
+
+        while (*len > 0 && n < MAX_LINE_LEN - 2) {
+                (*len)--;
+                if ((line[n++] = *(*head)++) == '\n') break;
+        }
+        if (n > 0 && (line[n - 1] == '\n' || n == MAX_LINE_LEN - 2)) {
+                line[n] = '\0';
+                return line;
+        }
+
+        if (!fgets(line + n, MAX_LINE_LEN - 1 - n, fp)) {
+                if (n == 0) return NULL;
+                line[n] = '\0';
         }
 
-        return 0;
+        return line;
 }
 
 /* Attempt a clean shutdown if a monitored signal is received */
@@ -256,8 +358,13 @@ void handle_signal(int sig) {
 
 /* Centralize cleanup functions for exit conditions */
 void cleanup() {
+        close_export();
         destroy_query();
-        destroy_index();
+        destroy_signatures();
+        destroy_scores();
+        destroy_index(doc_index);
+        doc_index = NULL;
+        destroy_shared_dict();
 
         return;
 }
@@ -265,15 +372,32 @@ void cleanup() {
 /* Display program help/usage information */
 void display_usage() {
         printf("%s version %s\n", PROG_NAME, PROG_VER);
-        printf("Usage: %s [OPTION] -t TERMFILE [DATAFILE]...\n\n", PROG_NAME);
-
-        printf("If no datafile, read standard input\n"
+        printf("Usage: %s [OPTION] -t TERMFILE [DATAFILE]...\n", PROG_NAME);
+        printf("       %s compile [OPTION] -t TERMFILE PROFILE\n\n", PROG_NAME);
+
+        printf("If no datafile, read standard input. A query profile written by\n"
+              "'compile' may be given as the termfile\n"
+              "    -a   number of data files to read ahead\n"
+              "    -c   directory for incremental index checkpoints\n"
+              "    -e   export document term vectors to this binary file\n"
+              "    -f   minimum score for a document to be ranked with -r\n"
               "    -h   display this help information and exit\n"
+              "    -k   number of top ranked documents to print with -r\n"
+              "    -l   limit index memory to this many megabytes\n"
               "    -m   specify a minimum word length\n"
+              "    -M   comma separated scoring models: cosine, tf, logtf, bm25\n"
+              "         (bm25 reads the data files twice)\n"
+              "    -n   reuse scores of near-duplicate documents\n"
+              "    -N   file to keep near-duplicate signatures in (implies -n)\n"
+              "    -p   number of threads used to split large files or search a directory\n"
+              "    -P   data files are pcap captures; score each HTTP connection\n"
               "    -q   disable non-critical output\n"
+              "    -r   rank every file below this directory instead of reading datafiles\n"
               "    -s   disable term stemming\n"
+              "    -S   estimate similarity of large files from this fraction of them\n"
               "    -t   input file containing query terms\n"
-              "    -w   disable removal of stop words\n\n");
+              "    -w   disable removal of stop words\n"
+              "    -x   input is HTML; index only the rendered text\n\n");
 
         printf("Additional information can be found at:\n"
               "    http://dumpsterventures.com/jason/vsm\n\n");
@@ -287,16 +411,41 @@ int main(int argc, char **argv) {
         extern int optind;
 
         signal(SIGINT, handle_signal);
+
+        /* Compile the query to a profile rather than scoring data */
+        if (argc > 1 && strcmp(argv[1], "compile") == 0) {
+                do_compile = 1;
+                argv[1] = argv[0];
+                argv++;
+                argc--;
+        }
+
+        /* Default to one thread per online processor */
+        num_threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
  
         /* Process command line arguments */
-        while ((opt = getopt(argc, argv, "hm:qst:w")) != -1) {
+        while ((opt = getopt(argc, argv, "a:c:e:f:hk:l:m:M:nN:p:Pqr:sS:t:wx")) != -1) {
                 switch (opt) {
+                        case 'a': read_ahead = atoi(optarg); break;
+                        case 'c': checkpoint_dir = optarg; break;
+                        case 'e': export_file = optarg; break;
+                        case 'f': min_score = atof(optarg); use_min_score = 1; break;
                         case 'h': display_usage(); break;
+                        case 'k': top_k = atoi(optarg); break;
+                        case 'l': mem_limit = atoi(optarg); break;
                         case 'm': min_len = atoi(optarg); break;
+                        case 'M': models = optarg; break;
+                        case 'n': do_dedup = 1; break;
+                        case 'N': do_dedup = 1; sigfile = optarg; break;
+                        case 'p': num_threads = atoi(optarg); break;
+                        case 'P': do_capture = 1; break;
                         case 'q': quiet_mode = 1; break;
+                        case 'r': rank_dir = optarg; break;
                         case 's': do_stemming = 0; break;
+                        case 'S': sample_rate = atof(optarg); break;
                         case 't': termfile = optarg; break;
                         case 'w': do_stop_words = 0; break;
+                        case 'x': do_html = 1; break;
                         default: display_usage();
                 }
         }
@@ -308,22 +457,98 @@ int main(int argc, char **argv) {
                 min_len = 0;
         }
 
+        if (num_threads < 1) {
+                WARN("Invalid -p value, setting to 1");
+                num_threads = 1;
+        }
+
+        if (mem_limit < 0) {
+                WARN("Invalid -l value, setting to 0");
+                mem_limit = 0;
+        }
+
+        if (read_ahead < 0) {
+                WARN("Invalid -a value, setting to 0");
+                read_ahead = 0;
+        }
+
+        if (top_k < 1) {
+                WARN("Invalid -k value, setting to %d", RANK_DEFAULT_K);
+                top_k = RANK_DEFAULT_K;
+        }
+
+        if (rank_dir && (do_dedup || checkpoint_dir || sample_rate > 0)) {
+                WARN("Options -c, -n and -S do not apply when ranking a directory");
+        }
+
+        if (models) select_models(models);
+
+        /* Documents found along the way can't be measured in advance */
+        if ((rank_dir || do_capture) && uses_lengths()) {
+                DIE("The bm25 model cannot be used with -P or -r");
+        }
+
+        if (sample_rate < 0 || sample_rate >= 1) {
+                WARN("Invalid -S value, sampling disabled");
+                sample_rate = 0;
+        }
+
+        /* Reading whole files ahead would defeat sampling, and checkpoints
+           only need the data appended since the last run */
+        if (sample_rate > 0 || checkpoint_dir) read_ahead = 0;
+
+        if (mem_limit != 0) PRINT("Index memory limited to %d MB", mem_limit);
         if (min_len != 0) PRINT("Minimum word length set to %d", min_len);
         if (do_stemming == 0) PRINT("Term stemming disabled");
         if (do_stop_words == 0) PRINT("Stop words disabled");
+        if (do_html) PRINT("Stripping HTML from input");
+        if (sample_rate > 0) PRINT("Sampling %.1f%% of large data files", 100 * sample_rate);
+        if (models) PRINT("Scoring with models %s", models);
+
+        select_pipeline();
 
         build_query(termfile);
 
-        if (optind == argc) {
+        if (do_compile) {
+                if (!query) DIE("Query file '%s' is already compiled", termfile);
+                if (optind != argc - 1) DIE("Exactly one profile file must be given to compile");
+
+                compile_profile(query, argv[optind]);
+                cleanup();
+
+                return EXIT_SUCCESS;
+        }
+
+        if (export_file) open_export(export_file);
+
+        /* Stored scores are only valid for the same query, term options
+           and scoring models */
+        if (sigfile) open_signature_store(sigfile, query_hash ^ models_fingerprint() << 32 ^
+                                          ((SIGNATURE) min_len << 3 | do_html << 2 | do_stop_words << 1 | do_stemming),
+                                          count_models());
+
+        if (do_capture) {
+                /* Captures are scored per connection rather than per file */
+                if (optind == argc) score_capture(NULL, query_ids, (size_t) mem_limit * 1024 * 1024);
+                while (optind < argc) {
+                        score_capture(argv[optind++], query_ids, (size_t) mem_limit * 1024 * 1024);
+                }
+        } else if (rank_dir) {
+                /* Search a whole tree in-process, keeping only the best */
+                rank_directory(rank_dir, query_ids, num_threads, top_k, (use_min_score) ? &min_score : NULL,
+                               (size_t) mem_limit * 1024 * 1024);
+        } else if (optind == argc) {
                 /* No datafile provided, read from STDIN */
-                build_index(NULL);
-                printf("Similarity: %.4f\n", calculate_similarity(query));
+                score_file(NULL);
         } else {
                 /* One or more datafiles given on command line */
+                if (uses_lengths() && argc - optind > 1) measure_files(argv + optind, argc - optind);
+
+                start_prefetch(argv + optind, argc - optind, read_ahead);
                 while (optind < argc) {
-                        build_index(argv[optind++]);
-                        printf("Similarity: %.4f\n", calculate_similarity(query));
+                        score_file(argv[optind++]);
                 }
+                stop_prefetch();
         }
 
         cleanup();
@@ -0,0 +1,258 @@
+/*
+
+  ----------------------------------------------------
+  vsm - vector space model data similarity
+  ----------------------------------------------------
+
+  Copyright (c) 2008 Jason Bittel <jason.bittel@gmail.com>
+
+*/
+
+/*
+  Read-ahead for runs over many small data files. A pool of reader threads
+  loads the contents of upcoming files into a ring of slots while the main
+  thread tokenizes and scores the current one. Files are always handed back
+  in command line order, so output is identical to a sequential run; the
+  ring holds at most 'depth' files at any time.
+*/
+
+#define _XOPEN_SOURCE 600
+#define _FILE_OFFSET_BITS 64
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include "error.h"
+#include "prefetch.h"
+
+#define SLOT_EMPTY 0
+#define SLOT_LOADING 1
+#define SLOT_READY 2
+#define SLOT_SKIPPED 3
+
+typedef struct slot SLOT;
+struct slot {
+        int state;
+        int file_num;
+        char *buf;
+        size_t len;
+};
+
+static SLOT *slots = NULL;
+static pthread_t *readers = NULL;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t slot_free = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t slot_ready = PTHREAD_COND_INITIALIZER;
+
+static char **file_list = NULL;
+static int num_files = 0;
+static int ring_size = 0;
+static int next_claim = 0;        /* Next file to be handed to a reader */
+static int next_serve = 0;        /* Next file to be handed to the caller */
+static int stopping = 0;
+
+void *read_files(void *arg);
+void load_file(SLOT *slot, char *filename);
+char *read_file(char *filename, size_t *len);
+
+/* Begin reading ahead through files using depth slots and reader threads */
+void start_prefetch(char **files, int count, int depth) {
+        int i;
+
+        if (slots || depth < 1 || count < 2) return;
+
+        file_list = files;
+        num_files = count;
+        ring_size = (depth < count) ? depth : count;
+        next_claim = next_serve = 0;
+        stopping = 0;
+
+        if ((slots = (SLOT *) calloc(ring_size, sizeof(SLOT))) == NULL) {
+                DIE("Cannot calloc memory for prefetch slots");
+        }
+        if ((readers = (pthread_t *) malloc(ring_size * sizeof(pthread_t))) == NULL) {
+                DIE("Cannot malloc memory for prefetch threads");
+        }
+
+        for (i = 0; i < ring_size; i++) {
+                if (pthread_create(&readers[i], NULL, read_files, NULL) != 0) {
+                        DIE("Cannot create prefetch thread");
+                }
+        }
+
+        PRINT("Reading ahead up to %d files", ring_size);
+
+        return;
+}
+
+/* Wait for the contents of filename, which must be the next file in
+   order; returns NULL if prefetch is inactive or the file was not loaded,
+   in which case the caller should read it directly */
+char *next_prefetched(char *filename, size_t *len) {
+        SLOT *slot;
+
+        if (!slots || next_serve >= num_files) return NULL;
+
+#ifdef DEBUG
+        ASSERT(filename == file_list[next_serve]);
+#else
+        (void) filename;
+#endif
+
+        slot = &slots[next_serve % ring_size];
+
+        pthread_mutex_lock(&lock);
+        while (slot->file_num != next_serve ||
+               (slot->state != SLOT_READY && slot->state != SLOT_SKIPPED)) {
+                pthread_cond_wait(&slot_ready, &lock);
+        }
+        pthread_mutex_unlock(&lock);
+
+        if (slot->state == SLOT_SKIPPED) {
+                release_prefetched();
+                return NULL;
+        }
+
+        *len = slot->len;
+
+        return slot->buf;
+}
+
+/* Hand the slot of the current file back to the readers */
+void release_prefetched() {
+        SLOT *slot;
+
+        if (!slots) return;
+
+        slot = &slots[next_serve % ring_size];
+
+        pthread_mutex_lock(&lock);
+        free(slot->buf);
+        slot->buf = NULL;
+        slot->len = 0;
+        slot->state = SLOT_EMPTY;
+        next_serve++;
+        pthread_cond_broadcast(&slot_free);
+        pthread_mutex_unlock(&lock);
+
+        return;
+}
+
+/* Shut down the reader threads and free any unconsumed contents */
+void stop_prefetch() {
+        int i;
+
+        if (!slots) return;
+
+        pthread_mutex_lock(&lock);
+        stopping = 1;
+        pthread_cond_broadcast(&slot_free);
+        pthread_mutex_unlock(&lock);
+
+        for (i = 0; i < ring_size; i++) {
+                pthread_join(readers[i], NULL);
+        }
+
+        for (i = 0; i < ring_size; i++) {
+                free(slots[i].buf);
+        }
+
+        free(readers);
+        free(slots);
+        readers = NULL;
+        slots = NULL;
+
+        return;
+}
+
+/* Reader thread entry point; repeatedly claim the next unread file and
+   load it once its slot in the ring has been released */
+void *read_files(void *arg) {
+        SLOT *slot;
+        int file_num;
+
+        (void) arg;
+
+        pthread_mutex_lock(&lock);
+        while (!stopping && next_claim < num_files) {
+                file_num = next_claim;
+                slot = &slots[file_num % ring_size];
+
+                /* Slot is still held by the file depth places earlier */
+                if (file_num >= next_serve + ring_size || slot->state != SLOT_EMPTY) {
+                        pthread_cond_wait(&slot_free, &lock);
+                        continue;
+                }
+
+                next_claim++;
+                slot->file_num = file_num;
+                slot->state = SLOT_LOADING;
+                pthread_mutex_unlock(&lock);
+
+                load_file(slot, file_list[file_num]);
+
+                pthread_mutex_lock(&lock);
+                pthread_cond_broadcast(&slot_ready);
+        }
+        pthread_mutex_unlock(&lock);
+
+        return NULL;
+}
+
+/* Read the whole of filename into slot; files that cannot be read or
+   are too large are marked as skipped */
+void load_file(SLOT *slot, char *filename) {
+        size_t len = 0;
+        char *buf;
+
+        buf = read_file(filename, &len);
+
+        pthread_mutex_lock(&lock);
+        slot->buf = buf;
+        slot->len = len;
+        slot->state = (buf) ? SLOT_READY : SLOT_SKIPPED;
+        pthread_mutex_unlock(&lock);
+
+        return;
+}
+
+/* Return a NUL terminated copy of the contents of filename, or NULL if it
+   is not a regular file of at most MAX_PREFETCH_SIZE bytes */
+char *read_file(char *filename, size_t *len) {
+        struct stat st;
+        char *buf;
+        ssize_t n = 0;
+        int fd;
+
+        if ((fd = open(filename, O_RDONLY)) < 0) return NULL;
+
+        if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) ||
+            st.st_size > MAX_PREFETCH_SIZE) {
+                close(fd);
+                return NULL;
+        }
+
+        if ((buf = (char *) malloc(st.st_size + 1)) == NULL) {
+                DIE("Cannot malloc memory for prefetch buffer");
+        }
+
+        *len = 0;
+        while (*len < (size_t) st.st_size &&
+               (n = read(fd, buf + *len, st.st_size - *len)) > 0) {
+                *len += n;
+        }
+        close(fd);
+
+        if (n < 0) {
+                free(buf);
+                return NULL;
+        }
+        buf[*len] = '\0';
+
+        return buf;
+}
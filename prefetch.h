@@ -0,0 +1,24 @@
+/*
+
+  ----------------------------------------------------
+  vsm - vector space model data similarity
+  ----------------------------------------------------
+
+  Copyright (c) 2008 Jason Bittel <jason.bittel@gmail.com>
+ 
+*/
+
+#ifndef _HAVE_PREFETCH_H
+#define _HAVE_PREFETCH_H
+
+#include <stddef.h>
+
+/* Files larger than this are left to the regular read path */
+#define MAX_PREFETCH_SIZE (4 * 1024 * 1024)
+
+void start_prefetch(char **files, int num_files, int depth);
+char *next_prefetched(char *filename, size_t *len);
+void release_prefetched();
+void stop_prefetch();
+
+#endif /* ! _HAVE_PREFETCH_H */
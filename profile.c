@@ -0,0 +1,206 @@
+/*
+
+  ----------------------------------------------------
+  vsm - vector space model data similarity
+  ----------------------------------------------------
+
+  Copyright (c) 2008 Jason Bittel <jason.bittel@gmail.com>
+
+*/
+
+/*
+  Precompiled query profiles. 'vsm compile' runs a query file through the
+  usual normalization, stop word filtering and stemming once and writes
+  the result to a small binary file: each distinct term with its
+  dictionary hash, the query as a sequence of references to those terms,
+  the term options it was built with and the fingerprint of the whole
+  query. A profile given in place of a query file is recognized by its
+  magic and mapped into memory; its terms are interned into the shared
+  dictionary using the stored hashes and the mapping is then released, so
+  short-lived processes skip the text processing entirely. Repeated terms
+  are weighted by their repeated references, exactly as in the query file.
+
+  Since the terms were filtered when the profile was compiled, a profile
+  can only be used with the same -m, -s and -w settings; -x does not
+  apply to query files.
+*/
+
+#define _XOPEN_SOURCE 600
+#define _FILE_OFFSET_BITS 64
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include "dedup.h"
+#include "dict.h"
+#include "error.h"
+#include "index.h"
+#include "profile.h"
+#include "tokenize.h"
+
+unsigned int profile_options();
+
+/* Return non-zero if filename holds a compiled query profile */
+int is_profile(char *filename) {
+        char magic[8];
+        FILE *fp;
+        size_t n;
+
+        if ((fp = fopen(filename, "rb")) == NULL) return 0;
+        n = fread(magic, 1, sizeof(magic), fp);
+        fclose(fp);
+
+        return n == sizeof(magic) && memcmp(magic, PROFILE_MAGIC, sizeof(magic)) == 0;
+}
+
+/* Encode the term options that affect query terms */
+unsigned int profile_options() {
+        return (unsigned int) min_len << 3 | do_stop_words << 1 | do_stemming;
+}
+
+/* Write the processed query terms to a profile; the file is written under
+   a temporary name and renamed into place, so processes loading it never
+   see a partial profile */
+void compile_profile(char **query, char *filename) {
+        PROFILE_HEADER hdr;
+        PROFILE_TERM *terms;
+        DICT *d;
+        FILE *fp;
+        char *tmp_path;
+        unsigned int *refs;
+        unsigned int offset = 0;
+        int i, id;
+
+        d = create_dict();
+        memset(&hdr, 0, sizeof(hdr));
+        for (i = 0; query[i]; i++);
+        terms = (PROFILE_TERM *) calloc(i, sizeof(PROFILE_TERM));
+        refs = (unsigned int *) malloc(i * sizeof(unsigned int));
+        if (!terms || !refs) {
+                DIE("Cannot malloc memory for profile terms");
+        }
+
+        /* Ids are handed out in order, so each new term is the next entry */
+        for (i = 0; query[i]; i++) {
+                id = intern_term(d, query[i], strlen(query[i]));
+                if (id == (int) hdr.num_terms) {
+                        terms[id].hash = hash_string(query[i], strlen(query[i]));
+                        terms[id].offset = offset;
+                        terms[id].len = strlen(query[i]);
+                        offset += terms[id].len + 1;
+                        hdr.num_terms++;
+                }
+                refs[hdr.num_refs++] = id;
+        }
+
+        memcpy(hdr.magic, PROFILE_MAGIC, sizeof(hdr.magic));
+        hdr.byte_order = PROFILE_BYTE_ORDER;
+        hdr.options = profile_options();
+        hdr.query_hash = hash_terms(query);
+
+        if ((tmp_path = (char *) malloc(strlen(filename) + 5)) == NULL) {
+                DIE("Cannot malloc memory for profile path");
+        }
+        sprintf(tmp_path, "%s.tmp", filename);
+
+        if ((fp = fopen(tmp_path, "wb")) == NULL) {
+                DIE("Cannot create profile file '%s'", tmp_path);
+        }
+        if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1 ||
+            fwrite(terms, sizeof(PROFILE_TERM), hdr.num_terms, fp) != hdr.num_terms ||
+            fwrite(refs, sizeof(unsigned int), hdr.num_refs, fp) != hdr.num_refs) {
+                DIE("Cannot write profile file '%s'", tmp_path);
+        }
+        for (i = 0; i < (int) hdr.num_terms; i++) {
+                if (fwrite(term_string(d, i), 1, terms[i].len + 1, fp) != terms[i].len + 1) {
+                        DIE("Cannot write profile file '%s'", tmp_path);
+                }
+        }
+        if (fclose(fp) != 0 || rename(tmp_path, filename) != 0) {
+                DIE("Cannot write profile file '%s'", filename);
+        }
+        PRINT("Query profile '%s' compiled with %u distinct terms", filename, hdr.num_terms);
+
+        free(tmp_path);
+        free(refs);
+        free(terms);
+        destroy_dict(d);
+
+        return;
+}
+
+/* Map a compiled profile and intern its terms, returning their ids in
+   query order, repeats included, terminated by -1; the fingerprint of the
+   query is stored in query_hash */
+int *load_profile(char *filename, unsigned long long *query_hash) {
+        PROFILE_HEADER *hdr;
+        PROFILE_TERM *terms;
+        struct stat st;
+        char *map, *strings;
+        unsigned int *refs;
+        unsigned int i;
+        int *ids, *term_ids, fd;
+
+        if ((fd = open(filename, O_RDONLY)) == -1) {
+                DIE("Cannot open file '%s'", filename);
+        }
+        if (fstat(fd, &st) != 0) {
+                DIE("Cannot stat file '%s'", filename);
+        }
+        if ((size_t) st.st_size < sizeof(PROFILE_HEADER)) {
+                DIE("Query profile '%s' is truncated", filename);
+        }
+        if ((map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+                DIE("Cannot map query profile '%s'", filename);
+        }
+        close(fd);
+
+        hdr = (PROFILE_HEADER *) map;
+        terms = (PROFILE_TERM *) (map + sizeof(PROFILE_HEADER));
+        refs = (unsigned int *) (terms + hdr->num_terms);
+        strings = (char *) (refs + hdr->num_refs);
+
+        if (hdr->byte_order != PROFILE_BYTE_ORDER) {
+                DIE("Query profile '%s' was compiled on a machine of different byte order", filename);
+        }
+        if ((size_t) st.st_size < sizeof(PROFILE_HEADER) + hdr->num_terms * sizeof(PROFILE_TERM) +
+                                  hdr->num_refs * sizeof(unsigned int) || hdr->num_terms == 0) {
+                DIE("Query profile '%s' is truncated", filename);
+        }
+        if (hdr->options != profile_options()) {
+                DIE("Query profile '%s' was compiled with -m %u%s%s; use the same options or recompile it",
+                    filename, hdr->options >> 3, (hdr->options & 2) ? "" : " -w", (hdr->options & 1) ? "" : " -s");
+        }
+
+        ids = (int *) malloc((hdr->num_refs + 1) * sizeof(int));
+        term_ids = (int *) malloc(hdr->num_terms * sizeof(int));
+        if (!ids || !term_ids) {
+                DIE("Cannot malloc memory for query term ids");
+        }
+
+        for (i = 0; i < hdr->num_terms; i++) {
+                if (strings + terms[i].offset + terms[i].len >= map + st.st_size) {
+                        DIE("Query profile '%s' is corrupt", filename);
+                }
+                term_ids[i] = resolve_term(strings + terms[i].offset, terms[i].len, terms[i].hash);
+        }
+
+        for (i = 0; i < hdr->num_refs; i++) {
+                if (refs[i] >= hdr->num_terms) DIE("Query profile '%s' is corrupt", filename);
+                ids[i] = term_ids[refs[i]];
+        }
+        ids[hdr->num_refs] = -1;
+        free(term_ids);
+
+        *query_hash = hdr->query_hash;
+        PRINT("Query profile '%s' loaded with dimensionality of %u", filename, hdr->num_refs);
+
+        munmap(map, st.st_size);
+
+        return ids;
+}
@@ -0,0 +1,43 @@
+/*
+
+  ----------------------------------------------------
+  vsm - vector space model data similarity
+  ----------------------------------------------------
+
+  Copyright (c) 2008 Jason Bittel <jason.bittel@gmail.com>
+
+*/
+
+#ifndef _HAVE_PROFILE_H
+#define _HAVE_PROFILE_H
+
+#define PROFILE_MAGIC "VSMQRY1"
+#define PROFILE_BYTE_ORDER 0x01020304
+
+/* Compiled query profile layout: the header, num_terms PROFILE_TERM
+   entries in order of first appearance in the query, the query itself as
+   num_refs unsigned int term indexes, then the NUL terminated term
+   strings the entries point into. Keeping the original order lets scores
+   be summed exactly as for the query file */
+typedef struct profile_header PROFILE_HEADER;
+struct profile_header {
+        char magic[8];
+        unsigned int byte_order;          /* PROFILE_BYTE_ORDER as written */
+        unsigned int options;             /* Term options the query was filtered with */
+        unsigned int num_terms;           /* Distinct terms */
+        unsigned int num_refs;            /* Query length, counting repeated terms */
+        unsigned long long query_hash;    /* hash_terms() of the full query */
+};
+
+typedef struct profile_term PROFILE_TERM;
+struct profile_term {
+        unsigned int hash;                /* Dictionary hash of the term */
+        unsigned int offset;              /* Start of the term string */
+        unsigned int len;
+};
+
+int is_profile(char *filename);
+void compile_profile(char **query, char *filename);
+int *load_profile(char *filename, unsigned long long *query_hash);
+
+#endif /* ! _HAVE_PROFILE_H */
@@ -0,0 +1,368 @@
+/*
+
+  ----------------------------------------------------
+  vsm - vector space model data similarity
+  ----------------------------------------------------
+
+  Copyright (c) 2008 Jason Bittel <jason.bittel@gmail.com>
+
+*/
+
+/*
+  Ranked search of a directory tree. A pool of worker threads shares two
+  queues: directories waiting to be read and files waiting to be scored.
+  An idle worker scores a queued file if there is one, and otherwise reads
+  the next directory, queueing the subdirectories and files it finds, so
+  the walk and the scoring proceed in parallel. The file queue is bounded;
+  a worker that finds it full scores the file on the spot instead, which
+  keeps memory constant however many files the tree holds. Symbolic links
+  are not followed.
+
+  Each worker reuses one private index. Only the best K documents by the
+  first selected model are kept, in a min-heap whose root is the weakest
+  result, and they are printed in order once the walk completes. Ties are
+  broken by name, and the models that need the average length of every
+  document (bm25) are refused, so the ranking doesn't depend on thread
+  scheduling.
+*/
+
+#define _XOPEN_SOURCE 600
+#define _FILE_OFFSET_BITS 64
+
+#include <dirent.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include "decompress.h"
+#include "error.h"
+#include "export.h"
+#include "html.h"
+#include "index.h"
+#include "rank.h"
+#include "score.h"
+#include "tokenize.h"
+
+typedef struct result RESULT;
+struct result {
+        float scores[MAX_MODELS];
+        char *name;
+};
+
+void *rank_worker(void *arg);
+void read_directory(INDEX *idx, char *path);
+void score_path(INDEX *idx, char *filename);
+void add_result(float *scores, char *filename);
+int compare_results(const RESULT *a, const RESULT *b);
+int compare_ranks(const void *a, const void *b);
+void sift_result_up(int i);
+void sift_result_down(int i);
+
+/* Work queues, guarded by queue_lock */
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work_ready = PTHREAD_COND_INITIALIZER;
+static char **dirs = NULL;
+static int num_dirs = 0;
+static int dirs_size = 0;
+static char *files[RANK_QUEUE_SIZE];
+static int file_head = 0;
+static int num_files = 0;
+static int busy_walkers = 0;      /* Workers reading a directory */
+
+/* Best results so far, guarded by result_lock along with the export */
+static pthread_mutex_t result_lock = PTHREAD_MUTEX_INITIALIZER;
+static RESULT *heap = NULL;
+static int heap_size = 0;
+static int heap_limit = 0;
+static int files_scored = 0;
+
+static int *rank_query = NULL;
+static float *rank_min_score = NULL;
+static size_t rank_mem_limit = 0;
+
+/* Score every regular file below dir with num_threads workers and print
+   the top_k results, best first; if min_score is given, documents
+   scoring below it are left out */
+void rank_directory(char *dir, int *query, int num_threads, int top_k, float *min_score, size_t mem_limit) {
+        pthread_t *workers;
+        int i;
+
+        rank_query = query;
+        prepare_query(query);
+        rank_min_score = min_score;
+        rank_mem_limit = mem_limit / num_threads;
+        heap_limit = top_k;
+
+        if ((heap = (RESULT *) malloc(top_k * sizeof(RESULT))) == NULL) {
+                DIE("Cannot malloc memory for results");
+        }
+        if ((dirs = (char **) malloc(RANK_BLOCKSIZE * sizeof(char *))) == NULL) {
+                DIE("Cannot malloc memory for directory queue");
+        }
+        dirs_size = RANK_BLOCKSIZE;
+        if ((dirs[0] = (char *) malloc(strlen(dir) + 1)) == NULL) {
+                DIE("Cannot malloc memory for directory name");
+        }
+        strcpy(dirs[0], dir);
+        num_dirs = 1;
+
+        PRINT("\nSearching '%s' with %d threads", dir, num_threads);
+
+        if ((workers = (pthread_t *) malloc(num_threads * sizeof(pthread_t))) == NULL) {
+                DIE("Cannot malloc memory for worker threads");
+        }
+        for (i = 1; i < num_threads; i++) {
+                if (pthread_create(&workers[i], NULL, rank_worker, NULL) != 0) {
+                        DIE("Cannot create worker thread %d", i);
+                }
+        }
+        rank_worker(NULL);
+        for (i = 1; i < num_threads; i++) {
+                pthread_join(workers[i], NULL);
+        }
+        free(workers);
+
+        PRINT("Scored %d files, ranking the top %d", files_scored, heap_size);
+        qsort(heap, heap_size, sizeof(RESULT), compare_ranks);
+        for (i = 0; i < heap_size; i++) {
+                print_similarity(heap[i].scores, "%d %s", i + 1, heap[i].name);
+                free(heap[i].name);
+        }
+
+        free(heap);
+        heap = NULL;
+        heap_size = 0;
+        free(dirs);
+        dirs = NULL;
+
+        return;
+}
+
+/* Worker thread entry point; take queued files and directories until the
+   walk is complete and every file has been taken */
+void *rank_worker(void *arg) {
+        INDEX *idx;
+        char *path;
+
+        (void) arg;
+
+        idx = create_index();
+        isolate_index(idx);
+        set_memory_limit(idx, rank_mem_limit);
+
+        pthread_mutex_lock(&queue_lock);
+        for (;;) {
+                if (num_files > 0) {
+                        path = files[file_head];
+                        file_head = (file_head + 1) % RANK_QUEUE_SIZE;
+                        num_files--;
+                        pthread_mutex_unlock(&queue_lock);
+
+                        score_path(idx, path);
+                        free(path);
+
+                        pthread_mutex_lock(&queue_lock);
+                } else if (num_dirs > 0) {
+                        path = dirs[--num_dirs];
+                        busy_walkers++;
+                        pthread_mutex_unlock(&queue_lock);
+
+                        read_directory(idx, path);
+                        free(path);
+
+                        pthread_mutex_lock(&queue_lock);
+                        busy_walkers--;
+
+                        /* Waiting workers may be done if this was the last */
+                        pthread_cond_broadcast(&work_ready);
+                } else if (busy_walkers == 0) {
+                        break;
+                } else {
+                        pthread_cond_wait(&work_ready, &queue_lock);
+                }
+        }
+        pthread_mutex_unlock(&queue_lock);
+
+        destroy_index(idx);
+
+        return NULL;
+}
+
+/* Queue the subdirectories and regular files of path */
+void read_directory(INDEX *idx, char *path) {
+        DIR *dp;
+        struct dirent *ent;
+        struct stat st;
+        char **tmp;
+        char *child;
+
+        if ((dp = opendir(path)) == NULL) {
+                WARN("Cannot open directory '%s'", path);
+                return;
+        }
+
+        while ((ent = readdir(dp))) {
+                if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0) continue;
+
+                if ((child = (char *) malloc(strlen(path) + strlen(ent->d_name) + 2)) == NULL) {
+                        DIE("Cannot malloc memory for file name");
+                }
+                sprintf(child, "%s/%s", path, ent->d_name);
+
+                if (lstat(child, &st) != 0) {
+                        WARN("Cannot stat file '%s'", child);
+                        free(child);
+                } else if (S_ISDIR(st.st_mode)) {
+                        pthread_mutex_lock(&queue_lock);
+                        if (num_dirs == dirs_size) {
+                                dirs_size += RANK_BLOCKSIZE;
+                                if ((tmp = (char **) realloc(dirs, dirs_size * sizeof(char *))) == NULL) {
+                                        DIE("Cannot realloc memory for directory queue");
+                                }
+                                dirs = tmp;
+                        }
+                        dirs[num_dirs++] = child;
+                        pthread_cond_signal(&work_ready);
+                        pthread_mutex_unlock(&queue_lock);
+                } else if (S_ISREG(st.st_mode)) {
+                        pthread_mutex_lock(&queue_lock);
+                        if (num_files < RANK_QUEUE_SIZE) {
+                                files[(file_head + num_files) % RANK_QUEUE_SIZE] = child;
+                                num_files++;
+                                pthread_cond_signal(&work_ready);
+                                child = NULL;
+                        }
+                        pthread_mutex_unlock(&queue_lock);
+
+                        /* Queue full; score it here rather than wait */
+                        if (child) {
+                                score_path(idx, child);
+                                free(child);
+                        }
+                } else {
+                        free(child);
+                }
+        }
+
+        closedir(dp);
+
+        return;
+}
+
+/* Index a single file into idx, score it and offer it to the results */
+void score_path(INDEX *idx, char *filename) {
+        FILE *fp;
+        HTML_STATE html;
+        char buf[MAX_LINE_LEN];
+        char *line;
+        float scores[MAX_MODELS];
+        int format;
+
+        initialize_index(idx);
+
+        if ((format = detect_compression(filename, NULL, 0))) {
+                build_index_compressed(idx, filename, NULL, 0, format);
+        } else {
+                if ((fp = fopen(filename, "r")) == NULL) {
+                        WARN("Cannot open file '%s'", filename);
+                        return;
+                }
+
+                init_html(&html);
+                while ((line = fgets(buf, sizeof(buf) - 1, fp))) {
+                        if (do_html) strip_html(&html, line);
+                        tokenize_line(idx, line);
+                }
+
+                fclose(fp);
+        }
+
+        score_quietly(idx, rank_query, scores);
+
+        /* The export file and the results are shared by every worker */
+        pthread_mutex_lock(&result_lock);
+        export_index(idx, filename);
+        files_scored++;
+        add_result(scores, filename);
+        pthread_mutex_unlock(&result_lock);
+
+        return;
+}
+
+/* Keep the document if it is among the best seen so far */
+void add_result(float *scores, char *filename) {
+        RESULT r;
+
+        if (rank_min_score && scores[0] < *rank_min_score) return;
+
+        memcpy(r.scores, scores, sizeof(r.scores));
+        r.name = filename;
+        if (heap_size == heap_limit && compare_results(&r, &heap[0]) <= 0) return;
+
+        if ((r.name = (char *) malloc(strlen(filename) + 1)) == NULL) {
+                DIE("Cannot malloc memory for result name");
+        }
+        strcpy(r.name, filename);
+
+        if (heap_size < heap_limit) {
+                heap[heap_size] = r;
+                sift_result_up(heap_size++);
+        } else {
+                free(heap[0].name);
+                heap[0] = r;
+                sift_result_down(0);
+        }
+
+        return;
+}
+
+/* Order results by their first score, then by name with earlier names
+   ranking higher; returns a negative value if a ranks below b */
+int compare_results(const RESULT *a, const RESULT *b) {
+        if (a->scores[0] != b->scores[0]) return (a->scores[0] < b->scores[0]) ? -1 : 1;
+
+        return strcmp(b->name, a->name);
+}
+
+/* qsort() comparison function for results, best first */
+int compare_ranks(const void *a, const void *b) {
+        return compare_results((const RESULT *) b, (const RESULT *) a);
+}
+
+/* Restore the heap order upwards from position i */
+void sift_result_up(int i) {
+        RESULT tmp;
+        int parent;
+
+        while (i > 0) {
+                parent = (i - 1) / 2;
+                if (compare_results(&heap[i], &heap[parent]) >= 0) break;
+
+                tmp = heap[i];
+                heap[i] = heap[parent];
+                heap[parent] = tmp;
+                i = parent;
+        }
+
+        return;
+}
+
+/* Restore the heap order downwards from position i */
+void sift_result_down(int i) {
+        RESULT tmp;
+        int child;
+
+        while ((child = 2 * i + 1) < heap_size) {
+                if (child + 1 < heap_size && compare_results(&heap[child + 1], &heap[child]) < 0) child++;
+                if (compare_results(&heap[child], &heap[i]) >= 0) break;
+
+                tmp = heap[i];
+                heap[i] = heap[child];
+                heap[child] = tmp;
+                i = child;
+        }
+
+        return;
+}
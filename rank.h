@@ -0,0 +1,24 @@
+/*
+
+  ----------------------------------------------------
+  vsm - vector space model data similarity
+  ----------------------------------------------------
+
+  Copyright (c) 2008 Jason Bittel <jason.bittel@gmail.com>
+
+*/
+
+#ifndef _HAVE_RANK_H
+#define _HAVE_RANK_H
+
+#include <stddef.h>
+
+/* Files found by the walk but not yet taken by a worker; a walker that
+   finds the queue full scores the file itself */
+#define RANK_QUEUE_SIZE 64
+#define RANK_BLOCKSIZE 64
+#define RANK_DEFAULT_K 10
+
+void rank_directory(char *dir, int *query, int num_threads, int top_k, float *min_score, size_t mem_limit);
+
+#endif /* ! _HAVE_RANK_H */
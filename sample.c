@@ -0,0 +1,206 @@
+/*
+
+  ----------------------------------------------------
+  vsm - vector space model data similarity
+  ----------------------------------------------------
+
+  Copyright (c) 2008 Jason Bittel <jason.bittel@gmail.com>
+
+*/
+
+/*
+  Similarity estimation for very large files. Rather than reading the whole
+  file, it is divided into SAMPLE_BLOCK_SIZE blocks and a fraction of them
+  is read with a stratified random design: the blocks are split into as
+  many equal strata as there are blocks to read, and one block is picked at
+  random from each stratum, so the sample is spread evenly over the file.
+  Each block is trimmed back to whitespace at both ends, dropping the words
+  that straddle its edges, and tokenized as any other data.
+
+  The sampled counts, scaled by the ratio of the file size to the bytes
+  tokenized, estimate the term frequencies of the whole file (see score.c). The
+  uncertainty of the estimate comes from the method of random groups: the
+  blocks are dealt round robin into SAMPLE_GROUPS replicates, each of which
+  is a smaller stratified sample of its own, and the spread of the
+  replicate scores gives the standard error of the full estimate. A
+  replicate whose blocks held no whole word has no score, and is left out
+  of the interval.
+
+  With -x, a block may begin inside a tag, a comment or a script, where
+  the markup state of a sequential read is unknown, so it is tokenized
+  only from the first tag that starts within it.
+
+  Blocks are picked from a generator seeded with the name of the file, so
+  repeated runs over the same file read the same blocks.
+*/
+
+#define _XOPEN_SOURCE 600
+#define _FILE_OFFSET_BITS 64
+
+#include <ctype.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include "decompress.h"
+#include "error.h"
+#include "index.h"
+#include "sample.h"
+#include "score.h"
+#include "tokenize.h"
+
+/* Two sided 95% Student's t values, by degrees of freedom */
+static double t_values[SAMPLE_GROUPS] = {
+        0, 12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262
+};
+
+unsigned long long next_random(unsigned long long *state);
+size_t read_block(INDEX *idx, int fd, char *buf, off_t offset, off_t size, char *filename);
+
+/* Estimate the similarity of filename from a sample of about rate of its
+   blocks and print it along with a 95% confidence interval for each
+   model. Returns 0, having read nothing, if the file is not a regular
+   file, is compressed, or is too small for sampling to save any reads */
+int score_sampled(char *filename, int *query, double rate, size_t mem_limit) {
+        INDEX *groups[SAMPLE_GROUPS];
+        off_t group_bytes[SAMPLE_GROUPS];
+        float replicates[SAMPLE_GROUPS][MAX_MODELS];
+        int scored[SAMPLE_GROUPS];
+        float scores[MAX_MODELS];
+        char note[64 + MAX_MODELS * 16];
+        char *buf, *p;
+        struct stat st;
+        unsigned long long seed;
+        off_t num_blocks, num_samples, lo, hi, k, bytes_read = 0;
+        double mean, var;
+        int fd, i, m, n;
+
+        if (stat(filename, &st) != 0 || !S_ISREG(st.st_mode)) return 0;
+
+        num_blocks = (st.st_size + SAMPLE_BLOCK_SIZE - 1) / SAMPLE_BLOCK_SIZE;
+        num_samples = (off_t) ceil(rate * num_blocks);
+        if (num_samples < SAMPLE_GROUPS) num_samples = SAMPLE_GROUPS;
+        if (num_samples >= num_blocks) return 0;
+
+        /* Compressed blocks can't be decoded out of sequence */
+        if (detect_compression(filename, NULL, 0) != COMPRESS_NONE) return 0;
+
+        if ((fd = open(filename, O_RDONLY)) == -1) {
+                DIE("\nCannot open file '%s'", filename);
+        }
+        PRINT("\nSampling data file '%s'", filename);
+
+        /* One extra byte for the character before the block, and one for
+           the terminator */
+        if ((buf = (char *) malloc(SAMPLE_BLOCK_SIZE + 2)) == NULL) {
+                DIE("Cannot malloc memory for sample block");
+        }
+
+        for (i = 0; i < SAMPLE_GROUPS; i++) {
+                groups[i] = create_index();
+                set_memory_limit(groups[i], mem_limit / SAMPLE_GROUPS);
+                group_bytes[i] = 0;
+        }
+
+        seed = 14695981039346656037ULL;
+        for (p = filename; *p; p++) {
+                seed = (seed ^ (unsigned char) *p) * 1099511628211ULL;
+        }
+
+        for (k = 0; k < num_samples; k++) {
+                lo = num_blocks * k / num_samples;
+                hi = num_blocks * (k + 1) / num_samples;
+                lo += (off_t) (next_random(&seed) % (unsigned long long) (hi - lo));
+
+                i = (int) (k % SAMPLE_GROUPS);
+                group_bytes[i] += read_block(groups[i], fd, buf, lo * SAMPLE_BLOCK_SIZE, st.st_size, filename);
+        }
+        close(fd);
+        free(buf);
+
+        for (i = 0; i < SAMPLE_GROUPS; i++) bytes_read += group_bytes[i];
+        PRINT("Sampled %lld blocks, tokenizing %lld of %lld bytes", (long long) num_samples,
+              (long long) bytes_read, (long long) st.st_size);
+
+        /* Score each replicate as an estimate of the whole file, then
+           combine them into the full sample */
+        for (n = 0, i = 0; i < SAMPLE_GROUPS; i++) {
+                if ((scored[i] = index_stats(groups[i])->num_insertions > 0)) n++;
+                score_replicate(groups[i], query, (group_bytes[i] > 0) ? (double) st.st_size / group_bytes[i] : 1,
+                                replicates[i]);
+        }
+        for (i = 1; i < SAMPLE_GROUPS; i++) {
+                merge_index(groups[0], groups[i]);
+                destroy_index(groups[i]);
+        }
+
+        if (index_stats(groups[0])->num_insertions == 0) WARN("No data found in '%s'", filename);
+        estimate_scores(groups[0], query, (bytes_read > 0) ? (double) st.st_size / bytes_read : 1, scores);
+        destroy_index(groups[0]);
+
+        p = note + sprintf(note, "estimated from %.1f%% of the file, 95%% CI", 100.0 * bytes_read / st.st_size);
+        if (n < 2) sprintf(p, " unavailable");
+        for (m = 0; n >= 2 && m < count_models(); m++) {
+                for (mean = 0, i = 0; i < SAMPLE_GROUPS; i++) {
+                        if (scored[i]) mean += replicates[i][m];
+                }
+                mean /= n;
+                for (var = 0, i = 0; i < SAMPLE_GROUPS; i++) {
+                        if (scored[i]) var += (replicates[i][m] - mean) * (replicates[i][m] - mean);
+                }
+                var /= (double) n * (n - 1);
+
+                p += sprintf(p, " +/-%.4f", t_values[n - 1] * sqrt(var));
+        }
+        print_similarity(scores, "%s", note);
+
+        return 1;
+}
+
+/* Return the next value of a xorshift64* generator */
+unsigned long long next_random(unsigned long long *state) {
+        *state ^= *state >> 12;
+        *state ^= *state << 25;
+        *state ^= *state >> 27;
+
+        return *state * 2685821657736338717ULL;
+}
+
+/* Read the block at offset and tokenize the whole words within it into
+   idx; returns the number of bytes tokenized, which leaves out the extra
+   leading byte and the words trimmed from either edge */
+size_t read_block(INDEX *idx, int fd, char *buf, off_t offset, off_t size, char *filename) {
+        char *start, *end;
+        off_t from;
+        ssize_t len;
+
+        /* Read the character before the block too, to tell whether the
+           block begins mid-word */
+        from = (offset > 0) ? offset - 1 : 0;
+        len = pread(fd, buf, SAMPLE_BLOCK_SIZE + (offset - from), from);
+        if (len < 0) DIE("Cannot read from file '%s'", filename);
+
+        start = buf;
+        end = buf + len;
+        if (offset > 0) {
+                while (start < end && !isspace((unsigned char) *start)) start++;
+        }
+        if (from + len < size) {
+                while (end > start && !isspace((unsigned char) *(end - 1))) end--;
+        }
+        *end = '\0';
+
+        /* Markup is only followed from the start of a tag */
+        if (do_html && offset > 0) {
+                while (start < end && !(start[0] == '<' && (isalpha((unsigned char) start[1]) ||
+                                                              start[1] == '/' || start[1] == '!'))) start++;
+        }
+
+        tokenize_buffer(idx, start, end - start);
+
+        return (size_t) (end - start);
+}
@@ -0,0 +1,24 @@
+/*
+
+  ----------------------------------------------------
+  vsm - vector space model data similarity
+  ----------------------------------------------------
+
+  Copyright (c) 2008 Jason Bittel <jason.bittel@gmail.com>
+
+*/
+
+#ifndef _HAVE_SAMPLE_H
+#define _HAVE_SAMPLE_H
+
+#include <stddef.h>
+
+/* Size of each block read from a sampled file */
+#define SAMPLE_BLOCK_SIZE (64 * 1024)
+
+/* Number of replicate groups the sampled blocks are dealt into */
+#define SAMPLE_GROUPS 10
+
+int score_sampled(char *filename, int *query, double rate, size_t mem_limit);
+
+#endif /* ! _HAVE_SAMPLE_H */
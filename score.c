@@ -0,0 +1,413 @@
+/*
+
+  ----------------------------------------------------
+  vsm - vector space model data similarity
+  ----------------------------------------------------
+
+  Copyright (c) 2008 Jason Bittel <jason.bittel@gmail.com>
+
+*/
+
+/*
+  Scoring models. A document is reduced once to a flat view holding the
+  frequency of each query term in a contiguous array along with whole
+  document statistics (see view_index()), and each selected model then
+  computes its similarity from that view alone, so any number of models
+  cost a single pass over the index. The models are:
+
+    cosine   tf / max tf weights with cosine normalization, and a weight
+             of 1 for each query term; the original vsm score
+    tf       cosine similarity of the raw term frequency vectors of the
+             document and the query
+    logtf    as tf, but with document terms weighted 1 + ln(tf)
+    bm25     Okapi BM25 with k1 = 1.2 and b = 0.75; documents are scored
+             one at a time as they are read, so there are no document
+             frequencies to derive IDF from and every term has an IDF of
+             1. The average document length is measured over all of the
+             data files in a first pass (see measure_lengths()) before
+             any is scored, so scores don't depend on the order of the
+             files; a lone document is its own average
+
+  A document estimated from a sample (see sample.c) is scored from a view
+  whose counts are scaled up to the size of the whole document. The length
+  of the document, its term frequencies and the log weight summations are
+  all corrected so that tf, logtf and bm25 see the estimated full document.
+  A uniform scaling alone would leave cosine unchanged, but the sum of
+  squared frequencies is estimated without the bias that squaring sampled
+  counts introduces (see scale_view()), so the cosine norm is corrected as
+  well.
+*/
+
+#define BM25_K1 1.2
+#define BM25_B 0.75
+
+/* score_view() flags */
+#define SCORE_COUNTED 1           /* Counts towards the average document length */
+#define SCORE_VERBOSE 2           /* Prints the cosine breakdown */
+
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "error.h"
+#include "index.h"
+#include "score.h"
+
+typedef struct model MODEL;
+struct model {
+        char *name;
+        float (*score)(DOC_VIEW *view);
+        int need_log;             /* Uses view->sum_log_squares */
+        int need_lengths;         /* Uses the average document length */
+};
+
+float score_cosine(DOC_VIEW *view);
+float score_tf(DOC_VIEW *view);
+float score_log_tf(DOC_VIEW *view);
+float score_bm25(DOC_VIEW *view);
+void score_view(INDEX *idx, int *query, double scale, float *scores, int flags);
+void scale_view(DOC_VIEW *v, double scale);
+void explain_cosine(DOC_VIEW *v, float similarity);
+int compare_ids(const void *a, const void *b);
+
+static MODEL model_table[] = {
+        { "cosine", score_cosine, 0, 0 },
+        { "tf", score_tf, 0, 0 },
+        { "logtf", score_log_tf, 1, 0 },
+        { "bm25", score_bm25, 0, 1 }
+};
+
+/* Selected models, as indexes into model_table, in output order */
+static int models[MAX_MODELS] = { 0 };
+static int num_models = 1;
+static int need_log = 0;
+static int need_lengths = 0;
+
+static int *view_query = NULL;    /* Query prepared for scoring */
+static int query_size = 0;
+static double query_norm = 0;     /* Euclidean length of the query vector */
+static double total_length = 0;   /* Document lengths seen, for BM25 */
+static int num_documents = 0;
+static int measuring = 0;         /* Only gather document lengths */
+static int lengths_known = 0;     /* Every document has been measured */
+
+/* Select the models to score with from a comma separated list of names */
+void select_models(char *list) {
+        char *name, *end;
+        int i, len;
+
+        num_models = 0;
+        need_log = 0;
+        need_lengths = 0;
+        for (name = list; *name; name = end + (*end == ',')) {
+                end = name + strcspn(name, ",");
+                len = end - name;
+
+                for (i = 0; i < (int) (sizeof(model_table) / sizeof(model_table[0])); i++) {
+                        if ((int) strlen(model_table[i].name) == len &&
+                            strncmp(model_table[i].name, name, len) == 0) break;
+                }
+                if (i == (int) (sizeof(model_table) / sizeof(model_table[0]))) {
+                        DIE("Unknown scoring model '%.*s'", len, name);
+                }
+                if (num_models == MAX_MODELS) {
+                        DIE("No more than %d scoring models may be selected", MAX_MODELS);
+                }
+
+                models[num_models++] = i;
+                need_log |= model_table[i].need_log;
+                need_lengths |= model_table[i].need_lengths;
+        }
+
+        if (num_models == 0) DIE("No scoring models selected");
+
+        return;
+}
+
+/* Return the number of selected models, which is the number of scores
+   produced for each document */
+int count_models() {
+        return num_models;
+}
+
+/* Return non-zero if a selected model compares each document with the
+   average length of all of them */
+int uses_lengths() {
+        return need_lengths;
+}
+
+/* With on set, begin a measuring pass in which documents are only counted
+   towards the average document length, scoring 0 and printing nothing.
+   Turning it off fixes the average for every document scored after */
+void measure_lengths(int on) {
+        measuring = on;
+        if (on) {
+                total_length = 0;
+                num_documents = 0;
+        }
+        lengths_known = !on;
+
+        return;
+}
+
+/* Identify the selected models; 0 for the default of cosine alone */
+unsigned long long models_fingerprint() {
+        unsigned long long h = 0;
+        int i;
+
+        for (i = 0; i < num_models; i++) {
+                h = h * 8 + models[i];
+        }
+        if (num_models > 1) h |= (unsigned long long) num_models << 60;
+
+        return h;
+}
+
+/* Score the index with every selected model; an empty index scores -1 */
+void score_index(INDEX *idx, int *query, float *scores) {
+        score_view(idx, query, 1, scores, SCORE_COUNTED | SCORE_VERBOSE);
+
+        return;
+}
+
+/* Score an index built from a sample of a document, as if each of its
+   counts were scale times larger */
+void estimate_scores(INDEX *idx, int *query, double scale, float *scores) {
+        score_view(idx, query, scale, scores, SCORE_COUNTED | SCORE_VERBOSE);
+
+        return;
+}
+
+/* As score_index(), but without printing the breakdown of the scores or
+   counting the index towards the average document length; used when many
+   documents are scored at once, on several threads, and only ranked. The
+   query must already have been prepared */
+void score_quietly(INDEX *idx, int *query, float *scores) {
+        score_view(idx, query, 1, scores, 0);
+
+        return;
+}
+
+/* As estimate_scores(), but silently and without counting the index as a
+   document of its own; used for the replicates of a sample */
+void score_replicate(INDEX *idx, int *query, double scale, float *scores) {
+        score_view(idx, query, scale, scores, 0);
+
+        return;
+}
+
+/* Reduce the index to a view, scaled if it was sampled, and score it with
+   every selected model. The view is private to the call, so indexes may be
+   scored on several threads once the query is prepared */
+void score_view(INDEX *idx, int *query, double scale, float *scores, int flags) {
+        DOC_VIEW view;
+        int i;
+
+        if (query != view_query) prepare_query(query);
+
+        if ((view.query_freqs = (float *) malloc((query_size + 1) * sizeof(float))) == NULL) {
+                DIE("Cannot malloc memory for query frequencies");
+        }
+
+        if (!view_index(idx, query, &view, need_log)) {
+                for (i = 0; i < num_models; i++) scores[i] = -1;
+                free(view.query_freqs);
+
+                return;
+        }
+        if (scale != 1) scale_view(&view, scale);
+
+        if ((flags & SCORE_COUNTED) && !lengths_known) {
+                total_length += view.length;
+                num_documents++;
+        }
+        if (measuring) {
+                for (i = 0; i < num_models; i++) scores[i] = 0;
+                free(view.query_freqs);
+
+                return;
+        }
+
+        for (i = 0; i < num_models; i++) {
+                scores[i] = model_table[models[i]].score(&view);
+                if ((flags & SCORE_VERBOSE) && model_table[models[i]].score == score_cosine) {
+                        explain_cosine(&view, scores[i]);
+                }
+        }
+        free(view.query_freqs);
+
+        return;
+}
+
+/* Scale every count in the view by the same factor. A term seen tf times
+   in a sample of 1 / s of a document is expected to have
+     tf^2 = s^2 * tf'^2 - s * (s - 1) * tf'
+   in the whole document, the usual unbiased estimate, rather than
+   s^2 * tf'^2, which inflates the many terms seen once or twice. Since
+     (1 + ln(s * tf)) = (1 + ln tf) + ln s
+   the log weight summations are corrected exactly from their unscaled
+   values */
+void scale_view(DOC_VIEW *v, double scale) {
+        double ln_scale = log(scale);
+        int i;
+
+        for (i = 0; i < v->query_size; i++) {
+                v->query_freqs[i] *= scale;
+        }
+
+        v->sum_squares = scale * scale * v->sum_squares - scale * (scale - 1) * v->length;
+        v->max_freq *= scale;
+        v->length *= scale;
+        v->sum_log_squares += 2 * ln_scale * v->sum_logs + v->num_terms * ln_scale * ln_scale;
+        v->sum_logs += v->num_terms * ln_scale;
+
+        return;
+}
+
+/* Print the scores of a document, one column per model, followed by an
+   optional parenthesized note */
+void print_similarity(float *scores, char *note, ...) {
+        va_list ap;
+        int i;
+
+        if (measuring) return;
+
+        printf("Similarity:");
+        for (i = 0; i < num_models; i++) {
+                printf(" %.4f", scores[i]);
+        }
+
+        if (note) {
+                printf(" (");
+                va_start(ap, note);
+                vprintf(note, ap);
+                va_end(ap);
+                printf(")");
+        }
+        printf("\n");
+
+        return;
+}
+
+/* Original vsm weighting:
+ *    (tf / max tf) / sqrt(summation((tf / max tf)^2))
+ * summed over the query terms, each with a weight of 1. Since the same
+ * query term can appear multiple times, technically they are weighted
+ * by frequency.
+ */
+float score_cosine(DOC_VIEW *v) {
+        float norm_comp;
+        float similarity = 0;
+        int i;
+
+        norm_comp = sqrt((float) (v->sum_squares / (v->max_freq * v->max_freq)));
+
+        for (i = 0; i < v->query_size; i++) {
+                similarity += (v->query_freqs[i] / (float) v->max_freq) / norm_comp;
+        }
+
+        return similarity;
+}
+
+/* Print the breakdown of a cosine score, term by term */
+void explain_cosine(DOC_VIEW *v, float similarity) {
+        float term_freq, norm_comp;
+        int i;
+
+        norm_comp = sqrt((float) (v->sum_squares / (v->max_freq * v->max_freq)));
+        PRINT("Cosine normalization component is %.2f", norm_comp);
+
+        if (!quiet_mode) {
+                for (i = 0; i < v->query_size; i++) {
+                        term_freq = v->query_freqs[i] / (float) v->max_freq;
+                        PRINT("   '%s' occurs %.2f times with weight %.2f", query_term(view_query[i]),
+                              term_freq, term_freq / norm_comp);
+                }
+        }
+        PRINT("Similarity: %.4f", similarity);
+
+        return;
+}
+
+/* Cosine similarity of raw term frequencies */
+float score_tf(DOC_VIEW *v) {
+        double dot = 0;
+        int i;
+
+        for (i = 0; i < v->query_size; i++) {
+                dot += v->query_freqs[i];
+        }
+
+        return dot / (sqrt(v->sum_squares) * query_norm);
+}
+
+/* Cosine similarity with document terms weighted 1 + ln(tf) */
+float score_log_tf(DOC_VIEW *v) {
+        double dot = 0;
+        int i;
+
+        for (i = 0; i < v->query_size; i++) {
+                if (v->query_freqs[i] > 0) dot += 1 + log(v->query_freqs[i]);
+        }
+
+        return dot / (sqrt(v->sum_log_squares) * query_norm);
+}
+
+/* Okapi BM25, with an IDF of 1 for every term */
+float score_bm25(DOC_VIEW *v) {
+        double avg_length = (num_documents) ? total_length / num_documents : v->length;
+        double k;
+        double similarity = 0;
+        int i;
+
+        k = BM25_K1 * (1 - BM25_B + BM25_B * v->length / avg_length);
+        for (i = 0; i < v->query_size; i++) {
+                similarity += v->query_freqs[i] * (BM25_K1 + 1) / (v->query_freqs[i] + k);
+        }
+
+        return similarity;
+}
+
+/* Prepare to score documents against a new query, finding the length of
+   its vector, counting repeated terms. Called by the first scoring
+   function to see the query; call it first when scoring on several
+   threads */
+void prepare_query(int *query) {
+        int *sorted;
+        int i, j, n;
+        double sum = 0;
+
+        for (n = 0; query[n] >= 0; n++);
+
+        if ((sorted = (int *) malloc((n + 1) * sizeof(int))) == NULL) {
+                DIE("Cannot malloc memory for sorted query");
+        }
+        memcpy(sorted, query, n * sizeof(int));
+        qsort(sorted, n, sizeof(int), compare_ids);
+
+        for (i = 0; i < n; i = j) {
+                for (j = i; j < n && sorted[j] == sorted[i]; j++);
+                sum += (double) (j - i) * (j - i);
+        }
+        free(sorted);
+
+        query_norm = sqrt(sum);
+        query_size = n;
+        view_query = query;
+
+        return;
+}
+
+/* qsort() comparison function for term ids */
+int compare_ids(const void *a, const void *b) {
+        return *(const int *) a - *(const int *) b;
+}
+
+/* Forget the prepared query */
+void destroy_scores() {
+        view_query = NULL;
+        query_size = 0;
+
+        return;
+}
@@ -0,0 +1,31 @@
+/*
+
+  ----------------------------------------------------
+  vsm - vector space model data similarity
+  ----------------------------------------------------
+
+  Copyright (c) 2008 Jason Bittel <jason.bittel@gmail.com>
+
+*/
+
+#ifndef _HAVE_SCORE_H
+#define _HAVE_SCORE_H
+
+#include "index.h"
+
+#define MAX_MODELS 4
+
+void select_models(char *list);
+int count_models();
+int uses_lengths();
+void measure_lengths(int on);
+unsigned long long models_fingerprint();
+void prepare_query(int *query);
+void score_index(INDEX *idx, int *query, float *scores);
+void score_quietly(INDEX *idx, int *query, float *scores);
+void estimate_scores(INDEX *idx, int *query, double scale, float *scores);
+void score_replicate(INDEX *idx, int *query, double scale, float *scores);
+void print_similarity(float *scores, char *note, ...);
+void destroy_scores();
+
+#endif /* ! _HAVE_SCORE_H */
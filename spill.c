@@ -0,0 +1,304 @@
+/*
+
+  ----------------------------------------------------
+  vsm - vector space model data similarity
+  ----------------------------------------------------
+
+  Copyright (c) 2008 Jason Bittel <jason.bittel@gmail.com>
+
+*/
+
+/*
+  Sorted runs of term counts written to disk when an index outgrows its
+  memory budget. Each run is an anonymous temporary file holding (length,
+  frequency, word) records in strcmp() order; merge_runs() performs a k-way
+  merge across all runs of a set and reports each distinct term exactly
+  once with its total frequency.
+
+  Every run holds an open file and a read buffer during a merge, so runs
+  are merged in cascades to keep their number bounded: whenever the last
+  MERGE_FAN_IN runs are all of the same level they are merged into a single
+  run of the next level, much like carrying in a counter. Each term record
+  is then rewritten only once per level, and a set never holds more than
+  MAX_RUNS runs however much data is spilled.
+*/
+
+#define RUN_BLOCKSIZE 10
+#define MERGE_FAN_IN 16
+#define MAX_RUNS (4 * MERGE_FAN_IN)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "error.h"
+#include "spill.h"
+#include "tokenize.h"
+
+struct run_set {
+        FILE **runs;
+        int *levels;              /* Number of cascaded merges behind each run */
+        int num_runs;
+};
+
+typedef struct run_reader RUN_READER;
+struct run_reader {
+        FILE *fp;
+        unsigned int freq;
+        char word[MAX_LINE_LEN];
+};
+
+void add_run(RUN_SET *runs, FILE *fp, int level);
+void cascade_runs(RUN_SET *runs);
+void merge_files(FILE **files, int num_files, void (*fn)(char *w, unsigned int freq, void *arg), void *arg);
+void write_merged_term(char *w, unsigned int freq, void *arg);
+int next_run_term(RUN_READER *r);
+void sift_down(RUN_READER **heap, int size, int i);
+
+/* Allocate a new, empty set of runs */
+RUN_SET *create_run_set() {
+        RUN_SET *runs;
+
+        if ((runs = (RUN_SET *) calloc(1, sizeof(RUN_SET))) == NULL) {
+                DIE("Cannot calloc memory for run set");
+        }
+
+        return runs;
+}
+
+/* Open a new temporary run in the set and return it for writing; the
+   previous run must be complete, as it may be merged first */
+FILE *new_run(RUN_SET *runs) {
+        FILE *fp;
+
+        cascade_runs(runs);
+
+        if ((fp = tmpfile()) == NULL) {
+                DIE("Cannot create temporary file for index run");
+        }
+        add_run(runs, fp, 0);
+
+        return fp;
+}
+
+/* Append an open run file of the given merge level to the set */
+void add_run(RUN_SET *runs, FILE *fp, int level) {
+        void *tmp;
+
+        if (runs->num_runs % RUN_BLOCKSIZE == 0) {
+                tmp = realloc(runs->runs, (runs->num_runs + RUN_BLOCKSIZE) * sizeof(FILE *));
+                if (!tmp) {
+                        DIE("Cannot realloc memory for run array");
+                }
+                runs->runs = tmp;
+
+                tmp = realloc(runs->levels, (runs->num_runs + RUN_BLOCKSIZE) * sizeof(int));
+                if (!tmp) {
+                        DIE("Cannot realloc memory for run array");
+                }
+                runs->levels = tmp;
+        }
+        runs->levels[runs->num_runs] = level;
+        runs->runs[runs->num_runs++] = fp;
+
+        return;
+}
+
+/* Merge the last MERGE_FAN_IN runs into one while they share a level, or
+   while the set holds too many runs; runs moved in from other sets can
+   leave the levels out of order, which the second case covers */
+void cascade_runs(RUN_SET *runs) {
+        FILE *fp;
+        int i, first, level;
+
+        while (runs->num_runs >= MERGE_FAN_IN) {
+                first = runs->num_runs - MERGE_FAN_IN;
+                level = runs->levels[first];
+                for (i = first + 1; i < runs->num_runs && runs->levels[i] == level; i++);
+                if (i < runs->num_runs && runs->num_runs < MAX_RUNS) break;
+
+                for (i = first; i < runs->num_runs; i++) {
+                        if (runs->levels[i] > level) level = runs->levels[i];
+                }
+
+                if ((fp = tmpfile()) == NULL) {
+                        DIE("Cannot create temporary file for index run");
+                }
+                merge_files(runs->runs + first, MERGE_FAN_IN, write_merged_term, fp);
+                if (fflush(fp) != 0) {
+                        DIE("Cannot write index run to disk");
+                }
+
+                for (i = first; i < runs->num_runs; i++) {
+                        fclose(runs->runs[i]);
+                }
+                runs->num_runs = first;
+                add_run(runs, fp, level + 1);
+        }
+
+        return;
+}
+
+/* Callback for merge_files(); append one merged term to the run in arg */
+void write_merged_term(char *w, unsigned int freq, void *arg) {
+        write_run_term((FILE *) arg, w, strlen(w), freq);
+
+        return;
+}
+
+/* Append a single term record to a run; terms must be written in
+   ascending strcmp() order */
+void write_run_term(FILE *fp, char *w, int len, unsigned int freq) {
+        if (fwrite(&len, sizeof(len), 1, fp) != 1 ||
+            fwrite(&freq, sizeof(freq), 1, fp) != 1 ||
+            fwrite(w, 1, len, fp) != (size_t) len) {
+                DIE("Cannot write index run to disk");
+        }
+
+        return;
+}
+
+/* Transfer all runs from src into dst, leaving src empty */
+void move_runs(RUN_SET *dst, RUN_SET *src) {
+        int i;
+
+        for (i = 0; i < src->num_runs; i++) {
+                add_run(dst, src->runs[i], src->levels[i]);
+        }
+        src->num_runs = 0;
+        cascade_runs(dst);
+
+        return;
+}
+
+/* Return the number of runs currently in the set */
+int count_runs(RUN_SET *runs) {
+        return runs->num_runs;
+}
+
+/* Merge all runs in the set, calling fn once for every distinct term in
+   ascending order along with its summed frequency */
+void merge_runs(RUN_SET *runs, void (*fn)(char *w, unsigned int freq, void *arg), void *arg) {
+        if (runs->num_runs == 0) return;
+
+        merge_files(runs->runs, runs->num_runs, fn, arg);
+
+        return;
+}
+
+/* Perform a k-way merge of num_files runs, as for merge_runs() */
+void merge_files(FILE **files, int num_files, void (*fn)(char *w, unsigned int freq, void *arg), void *arg) {
+        RUN_READER *readers, **heap;
+        RUN_READER *top;
+        char word[MAX_LINE_LEN];
+        unsigned int freq;
+        int i, size = 0;
+
+        readers = (RUN_READER *) malloc(num_files * sizeof(RUN_READER));
+        heap = (RUN_READER **) malloc(num_files * sizeof(RUN_READER *));
+        if (!readers || !heap) {
+                DIE("Cannot malloc memory for run merge");
+        }
+
+        /* Prime the heap with the first term of every run */
+        for (i = 0; i < num_files; i++) {
+                readers[i].fp = files[i];
+                rewind(readers[i].fp);
+                if (next_run_term(&readers[i])) heap[size++] = &readers[i];
+        }
+        for (i = size / 2 - 1; i >= 0; i--) {
+                sift_down(heap, size, i);
+        }
+
+        while (size > 0) {
+                strcpy(word, heap[0]->word);
+                freq = 0;
+
+                /* Drain every run whose current term matches */
+                while (size > 0 && strcmp(heap[0]->word, word) == 0) {
+                        top = heap[0];
+                        freq += top->freq;
+
+                        if (!next_run_term(top)) heap[0] = heap[--size];
+                        sift_down(heap, size, 0);
+                }
+
+                fn(word, freq, arg);
+        }
+
+        free(heap);
+        free(readers);
+
+        return;
+}
+
+/* Advance reader r to the next record of its run; returns 0 at end of run */
+int next_run_term(RUN_READER *r) {
+        int len;
+
+        if ((len = read_run_term(r->fp, r->word, &r->freq)) < 0) {
+                DIE("Corrupt index run on disk");
+        }
+
+        return len > 0;
+}
+
+/* Read a single term record written by write_run_term() into w, which
+   must hold MAX_LINE_LEN bytes; returns the length of the term, 0 at end
+   of file, or -1 if the record is malformed */
+int read_run_term(FILE *fp, char *w, unsigned int *freq) {
+        int len;
+
+        if (fread(&len, sizeof(len), 1, fp) != 1) return 0;
+
+        if (len <= 0 || len >= MAX_LINE_LEN ||
+            fread(freq, sizeof(*freq), 1, fp) != 1 ||
+            fread(w, 1, len, fp) != (size_t) len) {
+                return -1;
+        }
+        w[len] = '\0';
+
+        return len;
+}
+
+/* Restore the heap property below position i, ordering readers by word */
+void sift_down(RUN_READER **heap, int size, int i) {
+        RUN_READER *tmp;
+        int child;
+
+        while ((child = 2 * i + 1) < size) {
+                if (child + 1 < size && strcmp(heap[child + 1]->word, heap[child]->word) < 0)
+                        child++;
+                if (strcmp(heap[i]->word, heap[child]->word) <= 0) break;
+
+                tmp = heap[i];
+                heap[i] = heap[child];
+                heap[child] = tmp;
+                i = child;
+        }
+
+        return;
+}
+
+/* Close and discard all runs in the set */
+void clear_runs(RUN_SET *runs) {
+        int i;
+
+        for (i = 0; i < runs->num_runs; i++) {
+                fclose(runs->runs[i]);
+        }
+        runs->num_runs = 0;
+
+        return;
+}
+
+/* Release the run set and any runs still held by it */
+void destroy_run_set(RUN_SET *runs) {
+        if (!runs) return;
+
+        clear_runs(runs);
+        free(runs->runs);
+        free(runs->levels);
+        free(runs);
+
+        return;
+}
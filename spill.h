@@ -0,0 +1,28 @@
+/*
+
+  ----------------------------------------------------
+  vsm - vector space model data similarity
+  ----------------------------------------------------
+
+  Copyright (c) 2008 Jason Bittel <jason.bittel@gmail.com>
+ 
+*/
+
+#ifndef _HAVE_SPILL_H
+#define _HAVE_SPILL_H
+
+#include <stdio.h>
+
+typedef struct run_set RUN_SET;
+
+RUN_SET *create_run_set();
+FILE *new_run(RUN_SET *runs);
+void write_run_term(FILE *fp, char *w, int len, unsigned int freq);
+int read_run_term(FILE *fp, char *w, unsigned int *freq);
+void move_runs(RUN_SET *dst, RUN_SET *src);
+int count_runs(RUN_SET *runs);
+void merge_runs(RUN_SET *runs, void (*fn)(char *w, unsigned int freq, void *arg), void *arg);
+void clear_runs(RUN_SET *runs);
+void destroy_run_set(RUN_SET *runs);
+
+#endif /* ! _HAVE_SPILL_H */
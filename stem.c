@@ -47,9 +47,10 @@ static void step5();
  * should be done before stem(...) is called.
  */
 
-static char *b;   /* Buffer for word to be stemmed */
-static int k;     /* Points to the end of the word */
-static int j;     /* General offset into the string */
+/* Kept per thread so words can be stemmed concurrently */
+static __thread char *b;   /* Buffer for word to be stemmed */
+static __thread int k;     /* Points to the end of the word */
+static __thread int j;     /* General offset into the string */
 
 /* cons(i) is TRUE <=> b[i] is a consonant. */
 static int cons(int i) {
@@ -297,19 +298,19 @@ static void step5() {
 }
 
 /*
- * stem() takes a pointer to the word to be stemmed, adjusts the characters
- * p[0] ... p[strlen(p)-1] and returns the offset of the new end point of the
- * string, k. Stemming never increases word length, so b[0] <= k <= j.
+ * stem() takes a pointer to the word to be stemmed and its length, adjusts
+ * the characters p[0] ... p[len-1] and returns the new length of the string,
+ * k + 1. Stemming never increases word length, so b[0] <= k <= j.
  */
-int stem(char *p) {
+int stem(char *p, int len) {
         b = p;                  /* Copy initial values into statics */
-        k = strlen(p) - 1;      /* Set last char offset */
+        k = len - 1;            /* Set last char offset */
  
-        if (k <= 2) return k;   /* Skip short words */
+        if (k <= 2) return len; /* Skip short words */
 
         step1ab(); step1c(); step2(); step3(); step4(); step5();
 
         b[k + 1] = '\0';
  
-        return k;
+        return k + 1;
 }
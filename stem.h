@@ -11,6 +11,6 @@
 #ifndef _HAVE_STEM_H
 #define _HAVE_STEM_H
 
-int stem(char *p);
+int stem(char *p, int len);
 
 #endif /* ! _HAVE_STEM_H */
@@ -0,0 +1,243 @@
+/*
+
+  ----------------------------------------------------
+  vsm - vector space model data similarity
+  ----------------------------------------------------
+
+  Copyright (c) 2008 Jason Bittel <jason.bittel@gmail.com>
+
+*/
+
+/*
+  These functions turn raw lines of text into index terms: the line is
+  normalized, split into words, and each word is filtered and stemmed
+  according to the command line options. When the index is being checked
+  for near-duplicates, the normalized line is also added to its signature.
+  Nothing here keeps state between calls, so lines may be tokenized from
+  several threads at once.
+*/
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dedup.h"
+#include "error.h"
+#include "html.h"
+#include "index.h"
+#include "stem.h"
+#include "tokenize.h"
+
+/* Command line arguments */
+int min_len = 0;
+int do_stemming = 1;
+int do_stop_words = 1;
+int do_html = 0;
+
+/* Longest entry in the stop word list; longer words can't be stop words */
+#define MAX_STOP_LEN 8
+
+/*
+ * Each combination of the term filtering options gets its own copy of the
+ * filter and line tokenizer, generated below with the options folded in as
+ * constants. The matching pair is chosen once by select_pipeline(), so the
+ * per-word loop never tests an option that is switched off.
+ *
+ * The filter returns the (possibly stemmed) length of the term, or 0 if
+ * the term should be discarded.
+ */
+#define DEFINE_PIPELINE(name, MIN_LEN, STOP_WORDS, STEMMING)                    \
+static int filter_##name(char *w, int len) {                                   \
+        if (MIN_LEN && len < min_len) return 0;                                \
+        if (STOP_WORDS && len <= MAX_STOP_LEN && stop_word(w)) return 0;       \
+        if (STEMMING) len = stem(w, len);                                      \
+                                                                               \
+        return len;                                                            \
+}                                                                              \
+                                                                               \
+static void tokenize_##name(INDEX *idx, char *line) {                          \
+        SIG_STATE *sig;                                                        \
+        char *word;                                                            \
+        int len;                                                               \
+                                                                               \
+        line = standardize_line(line);                                         \
+        if ((sig = index_signature(idx))) sign_words(sig, line);               \
+        while ((word = next_word(&line, &len))) {                              \
+                if ((len = filter_##name(word, len))) insert_word(idx, word, len); \
+        }                                                                      \
+}
+
+DEFINE_PIPELINE(plain, 0, 0, 0)
+DEFINE_PIPELINE(stem, 0, 0, 1)
+DEFINE_PIPELINE(stop, 0, 1, 0)
+DEFINE_PIPELINE(stop_stem, 0, 1, 1)
+DEFINE_PIPELINE(min, 1, 0, 0)
+DEFINE_PIPELINE(min_stem, 1, 0, 1)
+DEFINE_PIPELINE(min_stop, 1, 1, 0)
+DEFINE_PIPELINE(min_stop_stem, 1, 1, 1)
+
+typedef struct pipeline PIPELINE;
+struct pipeline {
+        void (*tokenize)(INDEX *idx, char *line);
+        int (*filter)(char *w, int len);
+};
+
+/* Indexed by (min_len != 0) << 2 | do_stop_words << 1 | do_stemming */
+static PIPELINE pipelines[] = {
+        { tokenize_plain, filter_plain },
+        { tokenize_stem, filter_stem },
+        { tokenize_stop, filter_stop },
+        { tokenize_stop_stem, filter_stop_stem },
+        { tokenize_min, filter_min },
+        { tokenize_min_stem, filter_min_stem },
+        { tokenize_min_stop, filter_min_stop },
+        { tokenize_min_stop_stem, filter_min_stop_stem }
+};
+
+/* Active pipeline; defaults match the default option values */
+void (*tokenize_line)(INDEX *idx, char *line) = tokenize_stop_stem;
+int (*filter_term)(char *w, int len) = filter_stop_stem;
+
+/* Choose the pipeline variant for the current options; must be called
+   after the options are final and before any tokenizing begins */
+void select_pipeline() {
+        PIPELINE *p;
+
+        p = &pipelines[((min_len != 0) << 2) | ((do_stop_words != 0) << 1) | (do_stemming != 0)];
+        tokenize_line = p->tokenize;
+        filter_term = p->filter;
+
+        return;
+}
+
+/* Return the next word of a standardized line and store its length in
+   len, advancing line past it; returns NULL at the end of the line. Words
+   are NUL terminated in place */
+char *next_word(char **line, int *len) {
+        char *word = *line;
+        char *p;
+
+        /* standardize_line() leaves words separated by single spaces */
+        if (*word == '\0') return NULL;
+
+        /* TODO: Instead of merely stripping unwanted characters and
+         * tokenizing on spaces, we ought to implement a word delimeters
+         * table and split words using those. Really, it will probably be
+         * an inverted table: everything *not* specified is considered a
+         * word boundary */
+        for (p = word; *p && *p != ' '; p++);
+        *len = p - word;
+        if (*p) *p++ = '\0';
+        *line = p;
+
+        return word;
+}
+
+/* Copy the next line of an in-memory buffer into line, advancing buf;
+   lines are cut exactly as fgets() would with a MAX_LINE_LEN buffer.
+   Returns NULL once the end of the buffer is reached */
+char *buffer_line(char **buf, char *end, char *line) {
+        size_t n;
+
+        if (*buf >= end) return NULL;
+
+        for (n = 0; *buf + n < end && n < MAX_LINE_LEN - 2; ) {
+                if ((*buf)[n++] == '\n') break;
+        }
+
+        memcpy(line, *buf, n);
+        line[n] = '\0';
+        *buf += n;
+
+        return line;
+}
+
+/* Tokenize an in-memory copy of a data file */
+void tokenize_buffer(INDEX *idx, char *buf, size_t len) {
+        HTML_STATE html;
+        char line[MAX_LINE_LEN];
+        char *end = buf + len;
+
+        init_html(&html);
+        while (buffer_line(&buf, end, line)) {
+                if (do_html) strip_html(&html, line);
+                tokenize_line(idx, line);
+        }
+
+        return;
+}
+
+/* Normalize string into a sequence of single space delimited alphanumeric words (modifies str);
+   initial concept borrowed (and heavily adapted) from xref.c by Bert Bos */
+char *standardize_line(char *str) {
+        char *i, *j;
+
+#ifdef DEBUG
+        ASSERT(str);
+#endif
+
+        for (j = str, i = str; *j != '\0'; j++) {
+                if (isupper(*j)) *i++ = tolower(*j);            /* Convert to lowercase */
+                else if (isalnum(*j) || *j == '-') *i++ = *j;   /* Keep only alphanumerics and dashes */
+                else if (isspace(*j) && i != str &&            
+                            *(i - 1) != ' ') *i++ = ' ';        /* Separate all words with a single space */
+        }
+        *i = '\0';
+
+        return str;
+}
+
+/* Remove common correlative words that typically convey no meaning */
+int stop_word(char *word) {
+
+#ifdef DEBUG
+        ASSERT(word);
+#endif
+
+        switch (*word) {
+                case 'a':
+                        if (!strcmp(word, "a")) return 1;
+                        if (!strcmp(word, "after")) return 1;
+                        if (!strcmp(word, "also")) return 1;
+                        if (!strcmp(word, "although")) return 1;
+                        if (!strcmp(word, "an")) return 1;
+                        if (!strcmp(word, "and")) return 1;
+                        break;
+                case 'b':
+                        if (!strcmp(word, "because")) return 1;
+                        if (!strcmp(word, "both")) return 1;
+                        if (!strcmp(word, "but")) return 1;
+                        break;
+                case 'e':
+                        if (!strcmp(word, "either")) return 1;
+                        break;
+                case 'f':
+                        if (!strcmp(word, "for")) return 1;
+                        break;
+                case 'i':
+                        if (!strcmp(word, "if")) return 1;
+                        break;
+                case 'n':
+                        if (!strcmp(word, "nor")) return 1;
+                        if (!strcmp(word, "not")) return 1;
+                        break;
+                case 'o':
+                        if (!strcmp(word, "or")) return 1;
+                        break;
+                case 's':
+                        if (!strcmp(word, "so")) return 1;
+                        break;
+                case 't':
+                        if (!strcmp(word, "the")) return 1;
+                        break;
+                case 'u':
+                        if (!strcmp(word, "unless")) return 1;
+                        break;
+                case 'y':
+                        if (!strcmp(word, "yet")) return 1;
+                        break;
+                default: return 0;
+        }
+
+        return 0;
+}
@@ -0,0 +1,38 @@
+/*
+
+  ----------------------------------------------------
+  vsm - vector space model data similarity
+  ----------------------------------------------------
+
+  Copyright (c) 2008 Jason Bittel <jason.bittel@gmail.com>
+ 
+*/
+
+#ifndef _HAVE_TOKENIZE_H
+#define _HAVE_TOKENIZE_H
+
+#include <stddef.h>
+#include "index.h"
+
+#define MAX_LINE_LEN 2048
+
+/* Term filtering options; defined in tokenize.c, set from the command line */
+extern int min_len;
+extern int do_stemming;
+extern int do_stop_words;
+extern int do_html;
+
+/* Pipeline variant chosen by select_pipeline(); tokenize_line() normalizes
+   a line and inserts its terms into idx, filter_term() filters and stems a
+   single word returning its new length, or 0 if it is to be discarded */
+extern void (*tokenize_line)(INDEX *idx, char *line);
+extern int (*filter_term)(char *w, int len);
+
+void select_pipeline();
+char *buffer_line(char **buf, char *end, char *line);
+char *next_word(char **line, int *len);
+char *standardize_line(char *str);
+int stop_word(char *word);
+void tokenize_buffer(INDEX *idx, char *buf, size_t len);
+
+#endif /* ! _HAVE_TOKENIZE_H */